@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include "cache.h"
+#include "memory.h"
+#include "hierarchy.h"
+
+/*
+** Simulator throughput benchmark:
+**	synthetic access streams are generated in memory up front, then
+**	replayed through Cache::HandleRequest for every replace method,
+**	associativity and level count. One record per run on stdout.
+*/
+
+#define BENCH_LEVELS	3
+#define BENCH_LINE	64
+
+// Stream generators
+#define WL_SEQ		0
+#define WL_STRIDE	1
+#define WL_RANDOM	2
+#define WL_ZIPF		3
+#define WL_CHASE	4
+#define WL_MIXED	5
+#define WL_NUM		6
+
+const char *wl_name[WL_NUM] = { "sequential", "strided", "random", "zipf", "chase", "mixed" };
+
+// Level sizes (KB) for a 1-3 level hierarchy
+const int level_kb[BENCH_LEVELS] = { 32, 256, 2048 };
+
+const int assoc_list[] = { 1, 2, 4, 8, 16, 32 };
+
+uint64_t *bench_addr;
+int *bench_read;
+
+// xorshift64*, deterministic across runs
+uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+uint64_t Rand64()
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+double Rand01()
+{
+	return (Rand64() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Footprint of the random streams: 64MB of lines, well past every level
+#define FOOTPRINT_LINES	(1 << 20)
+
+void Generate(int workload, int num)
+{
+	rng_state = 0x9E3779B97F4A7C15ULL + workload;
+
+	if (workload == WL_SEQ) {
+		for (int i = 0; i < num; ++i) {
+			bench_addr[i] = (uint64_t) i * 8;
+			bench_read[i] = CACHE_READ;
+		}
+	}
+	else if (workload == WL_STRIDE) { // power-of-two stride, set conflicts
+		for (int i = 0; i < num; ++i) {
+			bench_addr[i] = ((uint64_t) i * 4096) % ((uint64_t) FOOTPRINT_LINES * BENCH_LINE);
+			bench_read[i] = CACHE_READ;
+		}
+	}
+	else if (workload == WL_RANDOM) {
+		for (int i = 0; i < num; ++i) {
+			bench_addr[i] = (Rand64() % FOOTPRINT_LINES) * BENCH_LINE;
+			bench_read[i] = CACHE_READ;
+		}
+	}
+	else if (workload == WL_ZIPF) { // s = 0.99 over the footprint, CDF + binary search
+		double *cdf = new double[FOOTPRINT_LINES];
+		double sum = 0;
+		for (int k = 0; k < FOOTPRINT_LINES; ++k)
+			cdf[k] = (sum += 1.0 / pow(k + 1, 0.99));
+		for (int i = 0; i < num; ++i) {
+			int k = std::lower_bound(cdf, cdf + FOOTPRINT_LINES, Rand01() * sum) - cdf;
+			if (k >= FOOTPRINT_LINES)
+				k = FOOTPRINT_LINES - 1;
+			// scatter ranks so hot lines do not share sets
+			bench_addr[i] = ((uint64_t) k * 0x9E3779B1ULL % FOOTPRINT_LINES) * BENCH_LINE;
+			bench_read[i] = CACHE_READ;
+		}
+		delete[] cdf;
+	}
+	else if (workload == WL_CHASE) { // one random cycle through the footprint
+		int *next = new int[FOOTPRINT_LINES];
+		for (int k = 0; k < FOOTPRINT_LINES; ++k)
+			next[k] = k;
+		for (int k = FOOTPRINT_LINES - 1; k > 0; --k)
+			std::swap(next[k], next[Rand64() % k]); // Sattolo: a single cycle
+		int cur = 0;
+		for (int i = 0; i < num; ++i) {
+			bench_addr[i] = (uint64_t) cur * BENCH_LINE;
+			bench_read[i] = CACHE_READ;
+			cur = next[cur];
+		}
+		delete[] next;
+	}
+	else { // WL_MIXED: 70% reads, half sequential half random
+		for (int i = 0; i < num; ++i) {
+			if (Rand64() & 1)
+				bench_addr[i] = (uint64_t) i * 8;
+			else
+				bench_addr[i] = (Rand64() % FOOTPRINT_LINES) * BENCH_LINE;
+			bench_read[i] = Rand01() < 0.7 ? CACHE_READ : CACHE_WRITE;
+		}
+	}
+}
+
+CacheConfig Bench_config(int lv, int assoc)
+{
+	CacheConfig config;
+
+	Make_config(config, lv + 1, level_kb[lv], assoc, BENCH_LINE, 0);
+	return config;
+}
+
+double Now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void usage(const char *prog)
+{
+	printf("Usage: %s [-n accesses] [-r repeats] [-f csv|json] [-w workload]\n", prog);
+}
+
+int main(int argc, char* argv[])
+{
+	int num = 1 << 16;
+	int repeats = 1;
+	int json = 0;
+	int only = -1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:f:w:")) != -1) {
+		switch (opt) {
+			case 'n': num = atoi(optarg); break;
+			case 'r': repeats = atoi(optarg); break;
+			case 'f': json = strcmp(optarg, "json") == 0; break;
+			case 'w':
+				for (int w = 0; w < WL_NUM; ++w)
+					if (strcmp(optarg, wl_name[w]) == 0)
+						only = w;
+				if (only == -1) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (num <= 0 || repeats <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	bench_addr = new uint64_t[num];
+	bench_read = new int[num];
+
+	if (!json)
+		printf("workload,policy,assoc,levels,accesses,ns_per_access,accesses_per_sec,l1_miss_rate\n");
+	for (int w = 0; w < WL_NUM; ++w) {
+		if (only != -1 && w != only)
+			continue;
+		Generate(w, num);
+
+		for (int levels = 1; levels <= BENCH_LEVELS; ++levels)
+		for (unsigned a = 0; a < sizeof(assoc_list) / sizeof(assoc_list[0]); ++a)
+		for (int RM = CACHE_RM_LRU; RM <= CACHE_RM_LIFO; ++RM) {
+			Memory memory;
+			Cache *cache[BENCH_LEVELS];
+
+			cache[levels-1] = new Cache(Bench_config(levels-1, assoc_list[a]), &memory, &memory,
+				Default_latency(level_kb[levels-1]));
+			Check_allocated(cache[levels-1], levels);
+			for (int lv = levels - 2; lv >= 0; --lv) {
+				cache[lv] = new Cache(Bench_config(lv, assoc_list[a]), cache[lv+1], &memory,
+					Default_latency(level_kb[lv]));
+				Check_allocated(cache[lv], lv + 1);
+			}
+
+			// best of repeats, each on a freshly reset hierarchy
+			double best = 1e30;
+			StorageStats l1;
+			for (int r = 0; r < repeats; ++r) {
+				memory.Reset();
+				for (int lv = 0; lv < levels; ++lv)
+					cache[lv] -> Reset();
+
+				double start = Now();
+				for (int i = 0; i < num; ++i)
+					cache[0] -> HandleRequest(bench_addr[i], bench_read[i], RM);
+				double elapsed = Now() - start;
+				if (elapsed < best)
+					best = elapsed;
+			}
+			cache[0] -> GetStats(l1);
+
+			double ns = best * 1e9 / num;
+			double miss_rate = (double) l1.miss_num / l1.access_counter;
+			if (json)
+				printf("{\"workload\":\"%s\",\"policy\":\"%s\",\"assoc\":%d,\"levels\":%d,"
+					"\"accesses\":%d,\"ns_per_access\":%.3f,\"accesses_per_sec\":%.0f,\"l1_miss_rate\":%.6f}\n",
+					wl_name[w], Retrieve_name(RM), assoc_list[a], levels, num, ns, num / best, miss_rate);
+			else
+				printf("%s,%s,%d,%d,%d,%.3f,%.0f,%.6f\n",
+					wl_name[w], Retrieve_name(RM), assoc_list[a], levels, num, ns, num / best, miss_rate);
+			fflush(stdout);
+
+			for (int lv = 0; lv < levels; ++lv)
+				delete cache[lv];
+		}
+	}
+
+	delete[] bench_addr;
+	delete[] bench_read;
+	return 0;
+}
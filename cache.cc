@@ -1,5 +1,6 @@
 #include "cache.h"
 #include "def.h"
+#include "profile.h"
 
 // Main access process
 // [in]	addr: access address
@@ -11,39 +12,88 @@
 
 void Cache::HandleRequest(uint64_t addr, int read, int replace_method) 
 {
+	PROFILE_SCOPE(config_.level, PROF_HANDLE);
 	uint64_t addr_tag;
 	int addr_set;
 	int victim;
 	int vicbuf; 
 	uint64_t weight;
 	
-	++stats_.access_counter;
 	PartitionAlgorithm(addr, addr_tag, addr_set);
+	if (!set_sampled_[addr_set]) { // set sampling: not simulated
+		++stats_.skip_num;
+		return;
+	}
+	++stats_.access_counter;
+	stream_ = StreamOf(addr);
+	if (config_.stream_num > 1)
+		++stream_stat_[stream_].access;
+	if (wbuf_cnt_ > 0 && config_.wbuf_timeout > 0)
+		WbufTick(replace_method);
+	HEAT_COUNT(addr_set, addr_tag, access);
+	PcStat *pc_stat = NULL;
+	if (pc_ != 0) {
+		pc_stat = &PcStatOf(pc_);
+		++pc_stat -> access;
+	}
+	if (config_.index_hash == CACHE_IDX_SKEW)
+		SkewGather(addr_tag);
 	
 	// Bypass?
-	if (!BypassDecision(addr_tag))  {
+	uint64_t bypass_tag = addr >> (config_.block_bit + config_.set_bit);
+	int bypass = BypassDecision(bypass_tag);
+	if (!bypass && config_.ship_bits > 0 && config_.ship_bypass)
+		bypass = ShipBypass(addr, addr_set, addr_tag);
+	// a block held here is not bypassed, an exclusive level below would
+	// take a second copy of it
+	if (bypass && lower_exclusive_ && (Lookup(addr_set, addr_tag) >= 0
+	 || (config_.victim_num > 0 && VictimLookup(addr >> config_.block_bit) >= 0)))
+		bypass = 0;
+	if (!bypass)  {
 		// calc bus latency
 		stats_.access_cycle += latency_.bus_latency;
 		// Miss?
-		if (ReplaceDecision(addr, victim, weight, replace_method)) { // HIT
+		int hit = ReplaceDecision(addr, victim, weight, replace_method);
+		if (!hit && config_.way_mask[stream_] != 0)
+			victim = WayQuotaVictim(addr_set, victim, replace_method);
+		if (hit) { // HIT
 			// hit latency
 			stats_.access_cycle += latency_.hit_latency;
 			// set weight
 			set_[addr_set].line_[victim].weight = weight;
+			ShipHit(set_[addr_set].line_[victim]);
 			// decide whether write back|through
 			if (read == CACHE_WRITE && config_.write_through == 0)
 				set_[addr_set].line_[victim].Init(CACHE_WB);
 			else if (read == CACHE_WRITE && config_.write_through == 1)
-				lower_ -> HandleRequest(addr, CACHE_WRITE, replace_method);
+				WbufWrite(addr, 0, replace_method);
+		}
+		else if (config_.victim_num > 0
+		 && (vicbuf = VictimLookup(addr >> config_.block_bit)) >= 0) { // VICTIM HIT
+			++stats_.victim_hit_num;
+			stats_.access_cycle += latency_.hit_latency;
+			VictimSwap(addr, victim, vicbuf, weight, read);
+			if (read == CACHE_WRITE && config_.write_through == 1)
+				WbufWrite(addr, 0, replace_method);
 		}
 		else { // MISS
 			++stats_.miss_num;
-			BypassUpdatestat(addr_tag, victim);
+			HEAT_COUNT(addr_set, addr_tag, miss);
+			if (pc_stat != NULL)
+				++pc_stat -> miss;
+			if (config_.stream_num > 1)
+				++stream_stat_[stream_].miss;
+			BypassUpdatestat(bypass_tag, victim);
+			if (wbuf_cnt_ > 0 && read == CACHE_READ)
+				WbufMatch(addr, replace_method);
 			// Prefetch?
 			if (PrefetchDecision(addr, vicbuf)) { // need to prefetch
 				if (vicbuf >= 0) { // if prefetch is legal
 					stats_.prefetch_num++;
 					PrefetchAlgorithm(addr, vicbuf);
+					// the prefetched blocks are read from below now
+					for (int i = 0; i < PF_BUF_DEPTH && wbuf_cnt_ > 0; ++i)
+						WbufMatch(pf_buf[vicbuf][i] << config_.block_bit, replace_method);
 				}
 				// finish the replacement
 				ReplaceAlgorithm(addr, victim, weight, read, replace_method);
@@ -51,15 +101,112 @@ void Cache::HandleRequest(uint64_t addr, int read, int replace_method)
 			else { // already prefetched
 				ReplaceAlgorithm(addr, victim, weight, read|(read<<1), replace_method);
 			}
+			ShipFill(addr_set, victim, addr, replace_method);
 		}
 	}
 	else { // BYPASS
+		++stats_.bypass_num;
+		if (wbuf_cnt_ > 0 && read == CACHE_READ)
+			WbufMatch(addr, replace_method);
 		lower_ -> HandleRequest(addr, read, replace_method);
 	}
+	if (config_.index_hash == CACHE_IDX_SKEW)
+		SkewScatter();
+}
+
+void Cache::Access(uint64_t addr, uint32_t size, int read, int replace_method, uint64_t pc, int tid)
+{
+	uint64_t first = addr >> config_.block_bit;
+	uint64_t last = size > 1 ? (addr + size - 1) >> config_.block_bit : first;
+
+	SetContext(pc, tid);
+	HandleRequest(addr, read, replace_method);
+	for (uint64_t block = first + 1; block <= last; ++block)
+		HandleRequest(block << config_.block_bit, read, replace_method);
+}
+
+void Cache::FastAccess(uint64_t addr, uint32_t size, int read, int replace_method)
+{
+	uint64_t first = addr >> config_.block_bit;
+	uint64_t last = size > 1 ? (addr + size - 1) >> config_.block_bit : first;
+
+	FastForward(addr, read, replace_method);
+	for (uint64_t block = first + 1; block <= last; ++block)
+		FastForward(block << config_.block_bit, read, replace_method);
+}
+
+/*
+** Fast-forward access for sampled simulation: tags, dirty bits and
+** replacement state follow HandleRequest, but no stats, bypass, prefetch
+** or heat map bookkeeping is done. access_counter still advances since
+** it is the replacement clock; sampled results only use stats deltas
+** taken inside detailed intervals. Inclusion, exclusion and write buffers
+** follow the detailed path; victim caches are not modelled, so sim does not
+** sample with them.
+*/
+void Cache::FastForward(uint64_t addr, int read, int replace_method)
+{
+	uint64_t addr_tag;
+	int addr_set;
+	int victim;
+	uint64_t weight;
+
+	PartitionAlgorithm(addr, addr_tag, addr_set);
+	if (!set_sampled_[addr_set])
+		return;
+	++stats_.access_counter;
+	stream_ = StreamOf(addr);
+	if (wbuf_cnt_ > 0 && config_.wbuf_timeout > 0)
+		WbufTick(replace_method);
+	if (config_.index_hash == CACHE_IDX_SKEW)
+		SkewGather(addr_tag);
+
+	int hit = ReplaceDecision(addr, victim, weight, replace_method);
+	if (!hit && config_.way_mask[stream_] != 0)
+		victim = WayQuotaVictim(addr_set, victim, replace_method);
+	if (hit) { // HIT
+		set_[addr_set].line_[victim].weight = weight;
+		if (read == CACHE_WRITE && config_.write_through == 0)
+			set_[addr_set].line_[victim].Init(CACHE_WB);
+		else if (read == CACHE_WRITE && config_.write_through == 1)
+			FastWriteBelow(addr, 0, replace_method);
+	}
+	else if (read == CACHE_WRITE && config_.write_allocate == 0) {
+		FastWriteBelow(addr, 1, replace_method);
+	}
+	else {
+		Line &line = set_[addr_set].line_[victim];
+		if (wbuf_cnt_ > 0 && read == CACHE_READ)
+			WbufMatch(addr, replace_method);
+		if (line.valid == 1) {
+			uint64_t victim_addr = BlockAddr(line.tag, addr_set);
+			int dirty = line.dirty;
+			if (config_.inclusion == CACHE_INCLUSIVE && upper_ != NULL) {
+				int upper_block = upper_ -> config_.block_size;
+				for (uint64_t a = victim_addr; a < victim_addr + config_.block_size; a += upper_block)
+					dirty |= upper_ -> Invalidate(a);
+			}
+			if (lower_exclusive_)
+				lower_cache_ -> Insert(victim_addr, dirty, replace_method);
+			else if (dirty)
+				lower_ -> FastForward(victim_addr, CACHE_WRITE, replace_method);
+		}
+		line.valid = 1;
+		line.dirty = (read == CACHE_WRITE);
+		line.tag = addr_tag;
+		line.weight = weight;
+		if (lower_exclusive_) // the block moves up, no copy is left below
+			line.dirty |= lower_cache_ -> FastExtract(addr, replace_method);
+		else
+			lower_ -> FastForward(addr, read, replace_method);
+	}
+	if (config_.index_hash == CACHE_IDX_SKEW)
+		SkewScatter();
 }
 
 int Cache::BypassDecision(uint64_t addr_tag) 
 {
+	PROFILE_SCOPE(config_.level, PROF_BYPASS);
 	int bypass_shiftbit = config_.bypass_shiftbit;
 	double bypass_threshold = config_.bypass_threshold;
 
@@ -77,6 +224,7 @@ int Cache::BypassDecision(uint64_t addr_tag)
 
 void Cache::BypassUpdatestat(uint64_t addr_tag, int victim)
 {
+	PROFILE_SCOPE(config_.level, PROF_BYPASS);
 	int bypass_shiftbit = config_.bypass_shiftbit;
 
 	if (bypass_shiftbit >= 0) {
@@ -87,10 +235,11 @@ void Cache::BypassUpdatestat(uint64_t addr_tag, int victim)
 
 int Cache::PrefetchDecision(uint64_t addr, int &vicbuf) 
 {
+	PROFILE_SCOPE(config_.level, PROF_PREFETCH);
 	vicbuf = -1;
 
 	for (int i = 0; i < config_.pf_buf_num; ++i) {
-		for(int j = 0; j < 4; ++j)
+		for (int j = 0; j < PF_BUF_DEPTH; ++j)
 			if (pf_buf[i][j] == (addr >> config_.block_bit)) return FALSE;
 		if (vicbuf == -1 || pf_buf_info[i] < pf_buf_info[vicbuf])
 			vicbuf = i;
@@ -100,7 +249,8 @@ int Cache::PrefetchDecision(uint64_t addr, int &vicbuf)
 
 void Cache::PrefetchAlgorithm(uint64_t addr, int vicbuf) 
 {
-	for (int i = 0; i < 4; ++i)
+	PROFILE_SCOPE(config_.level, PROF_PREFETCH);
+	for (int i = 0; i < PF_BUF_DEPTH; ++i)
 		pf_buf[vicbuf][i] = (addr >> config_.block_bit) + i + 1;
 	pf_buf_info[vicbuf] = stats_.access_counter;
 }
@@ -108,9 +258,140 @@ void Cache::PrefetchAlgorithm(uint64_t addr, int vicbuf)
 void Cache::PartitionAlgorithm(uint64_t addr, uint64_t &addr_tag, int &addr_set)
 {
 	int tag_bit = config_.block_bit + config_.set_bit;
+	uint64_t block = addr >> config_.block_bit;
 	
-	addr_tag = (addr & (ADDR_MASK << tag_bit)) >> tag_bit;
-	addr_set = (addr & ~(ADDR_MASK << tag_bit)) >> config_.block_bit;
+	if (config_.index_hash == CACHE_IDX_MODULO) {
+		addr_tag = (addr & (ADDR_MASK << tag_bit)) >> tag_bit;
+		addr_set = (addr & ~(ADDR_MASK << tag_bit)) >> config_.block_bit;
+		return;
+	}
+
+	// hashed index: the tag keeps the whole block number
+	addr_tag = block;
+	if (config_.index_hash == CACHE_IDX_XOR) {
+		uint64_t fold = 0;
+		if (config_.set_bit > 0)
+			for (; block != 0; block >>= config_.set_bit)
+				fold ^= block & (config_.set_num - 1);
+		addr_set = (int) fold;
+	}
+	else if (config_.index_hash == CACHE_IDX_PRIME)
+		addr_set = (int) (block % prime_);
+	else // CACHE_IDX_SKEW, lines are gathered into the scratch set
+		addr_set = config_.set_num;
+}
+
+uint64_t Cache::BlockAddr(uint64_t tag, int addr_set)
+{
+	if (config_.index_hash == CACHE_IDX_MODULO) {
+		int tag_bit = config_.block_bit + config_.set_bit;
+		return (tag << tag_bit) | ((uint64_t) addr_set << config_.block_bit);
+	}
+	return tag << config_.block_bit;
+}
+
+int Cache::SkewSet(uint64_t block, int way)
+{
+	if (config_.set_bit == 0)
+		return 0;
+	uint64_t h = (block ^ (way * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+	h ^= h >> 31;
+	return (int) (h >> (64 - config_.set_bit));
+}
+
+void Cache::SkewGather(uint64_t block)
+{
+	Line *scratch = set_[config_.set_num].line_;
+
+	for (int i = 0; i < config_.associativity; ++i) {
+		skew_slot_[i] = &set_[SkewSet(block, i)].line_[i];
+		scratch[i] = *skew_slot_[i];
+	}
+	skew_active_ = 1;
+}
+
+void Cache::SkewScatter()
+{
+	Line *scratch = set_[config_.set_num].line_;
+
+	for (int i = 0; i < config_.associativity; ++i)
+		*skew_slot_[i] = scratch[i];
+	skew_active_ = 0;
+}
+
+// FIFO/LIFO reorder the ways of a set, which would move lines out of their
+// skewed sets or their stream's way quota, so there they go by insertion
+// time instead
+int Cache::StampFifoDecision(int addr_set, uint64_t addr_tag, int &victim, uint64_t &weight, int replace_method)
+{
+	Line *line = set_[addr_set].line_;
+
+	victim = -1;
+	for (int i = 0; i < config_.associativity; ++i) {
+		if (!line[i].valid) {
+			if (victim == -1 || line[victim].valid)
+				victim = i;
+			continue;
+		}
+		if (line[i].tag == addr_tag) {
+			victim = i;
+			weight = line[i].weight;
+			return TRUE;
+		}
+		if (victim == -1 || (line[victim].valid
+		 && (replace_method == CACHE_RM_FIFO ? line[i] < line[victim] : line[i] > line[victim])))
+			victim = i;
+	}
+	weight = stats_.access_counter;
+	return FALSE;
+}
+
+// Fallback victim when a policy finds no candidate: lowest weight line
+int Cache::LeastWeight(int addr_set)
+{
+	int victim = 0;
+
+	for (int i = 1; i < config_.associativity; ++i)
+		if (set_[addr_set].line_[i] < set_[addr_set].line_[victim])
+			victim = i;
+	return victim;
+}
+
+/*
+** The replace method picked a way outside the stream's quota: take a free
+** way of the quota, else the quota's line the method would evict first
+** (least weight; most for MRU and LIFO, random for RR). Exact for the
+** LRU/LFU families and for FIFO/LIFO, which go by insertion time under
+** quotas; an approximation for SLRU and ARC
+*/
+int Cache::WayQuotaVictim(int addr_set, int victim, int replace_method)
+{
+	uint32_t mask = config_.way_mask[stream_];
+	Line *line = set_[addr_set].line_;
+	int pick = -1, ways = 0;
+
+	if ((mask >> victim) & 1)
+		return victim;
+	for (int i = 0; i < config_.associativity; ++i) {
+		if (((mask >> i) & 1) == 0)
+			continue;
+		if (!line[i].valid)
+			return i;
+		++ways;
+		if (pick == -1)
+			pick = i;
+		else if (replace_method == CACHE_RM_RR) {
+			if (Random() % ways == 0)
+				pick = i;
+		}
+		else if (replace_method == CACHE_RM_MRU || replace_method == CACHE_RM_LIFO) {
+			if (line[i] > line[pick])
+				pick = i;
+		}
+		else if (line[i] < line[pick])
+			pick = i;
+	}
+	return pick;
 }
 
 /* 
@@ -126,12 +407,15 @@ void Cache::PartitionAlgorithm(uint64_t addr, uint64_t &addr_tag, int &addr_set)
 */
 int Cache::ReplaceDecision(uint64_t addr, int &victim, uint64_t &weight, int replace_method)
 {
+	PROFILE_SCOPE(config_.level, PROF_DECISION);
 	uint64_t addr_tag;
 	int addr_set;
 	int cold_line = -1;
 	victim = -1;
 	
 	PartitionAlgorithm(addr, addr_tag, addr_set);
+	if (StampFifo() && (replace_method == CACHE_RM_FIFO || replace_method == CACHE_RM_LIFO))
+		return StampFifoDecision(addr_set, addr_tag, victim, weight, replace_method);
 	if (replace_method == CACHE_RM_LRU) {
 		for (int i = 0; i < config_.associativity; ++i) {
 			if (set_[addr_set].line_[i].valid) {
@@ -194,7 +478,7 @@ int Cache::ReplaceDecision(uint64_t addr, int &victim, uint64_t &weight, int rep
 		if (cold_line != -1)
 			victim = cold_line;
 		else
-			victim = rand()%config_.associativity;
+			victim = Random() % config_.associativity;
 		return FALSE;
 
 	}
@@ -219,7 +503,7 @@ int Cache::ReplaceDecision(uint64_t addr, int &victim, uint64_t &weight, int rep
 						|| set_[addr_set].line_[j] < set_[addr_set].line_[pro_victim])
 							pro_victim = j;
 					}
-					if (protected_num >= SLRU_lim) 
+					if (protected_num >= SLRU_lim && pro_victim != -1) 
 						set_[addr_set].line_[pro_victim].weight ^= 1;
 					// level up to protected
 					weight = (stats_.access_counter << 1) | 1;
@@ -241,6 +525,8 @@ int Cache::ReplaceDecision(uint64_t addr, int &victim, uint64_t &weight, int rep
 		weight = stats_.access_counter << 1;
 		if (cold_line != -1)
 			victim = cold_line;
+		else if (victim == -1) // all protected (associativity 1)
+			victim = LeastWeight(addr_set);
 		return FALSE;
 	}
 	else if (replace_method == CACHE_RM_LFU) {
@@ -285,7 +571,7 @@ int Cache::ReplaceDecision(uint64_t addr, int &victim, uint64_t &weight, int rep
 						|| set_[addr_set].line_[j] < set_[addr_set].line_[pro_victim])
 							pro_victim = j;
 					}
-					if (protected_num >= LFRU_lim) 
+					if (protected_num >= LFRU_lim && pro_victim != -1) 
 						set_[addr_set].line_[pro_victim].weight ^= 1;
 					// level up to protected
 					weight = (set_[addr_set].line_[i].weight + 2) | 1;
@@ -307,6 +593,8 @@ int Cache::ReplaceDecision(uint64_t addr, int &victim, uint64_t &weight, int rep
 		weight = 2;
 		if (cold_line != -1)
 			victim = cold_line;
+		else if (victim == -1) // all protected (associativity 1)
+			victim = LeastWeight(addr_set);
 		return FALSE;
 	}
 	else if (replace_method == CACHE_RM_LFUDA) {
@@ -364,6 +652,8 @@ int Cache::ReplaceDecision(uint64_t addr, int &victim, uint64_t &weight, int rep
 							|| (set_[addr_set].line_[j].weight>>32) < (set_[addr_set].line_[pro_victim].weight>>32))
 								pro_victim = j;
 						}
+						if (pro_victim == -1) // nothing to demote (associativity 1)
+							break;
 						if (protected_num >= ARC_lim) {
 							--protected_num;
 							set_[addr_set].B2_push(pro_victim);
@@ -392,8 +682,11 @@ int Cache::ReplaceDecision(uint64_t addr, int &victim, uint64_t &weight, int rep
 		weight = stats_.access_counter << 1;
 		if (cold_line != -1)
 			victim = cold_line;
-		else
+		else {
+			if (victim == -1) // all protected (associativity 1)
+				victim = LeastWeight(addr_set);
 			set_[addr_set].B1_push(victim);
+		}
 
 		return FALSE;
 	}
@@ -453,44 +746,35 @@ int Cache::ReplaceDecision(uint64_t addr, int &victim, uint64_t &weight, int rep
 
 void Cache::ReplaceAlgorithm(uint64_t addr, int victim, uint64_t weight, int read, int replace_method) 
 {
+	PROFILE_SCOPE(config_.level, PROF_REPLACE);
 	uint64_t addr_tag;
 	int addr_set;
 
 	PartitionAlgorithm(addr, addr_tag, addr_set);
 	if((read&1) == CACHE_READ) { // cache_read
-		if(set_[addr_set].line_[victim].valid == 1) {
-			++stats_.replace_num;
-			if(set_[addr_set].line_[victim].dirty == 1) {
-				int tag_bit = config_.block_bit + config_.set_bit;
-				uint64_t victim_addr = (set_[addr_set].line_[victim].tag << tag_bit) | (addr_set << config_.block_bit);
-				// write back dirty
-				lower_ -> HandleRequest(victim_addr, CACHE_WRITE, replace_method);
-			}
-		}
+		Evict(addr_set, victim, replace_method);
 		// set cache info
 		set_[addr_set].line_[victim].valid = 1;
 		set_[addr_set].line_[victim].dirty = 0;
 		set_[addr_set].line_[victim].tag = addr_tag;
 		set_[addr_set].line_[victim].weight = weight;
 		
-		// read cache
-		if ((read>>1) != CACHE_READ) // not prefetch
-			lower_ -> HandleRequest(addr, CACHE_READ, replace_method);
+		// read cache; a prefetched block still goes through an inclusive
+		// or exclusive level below, which must keep or drop its copy
+		if ((read>>1) != CACHE_READ
+		 || (lower_cache_ != NULL && lower_cache_ -> config_.inclusion != CACHE_NINE)) {
+			if (lower_exclusive_)
+				set_[addr_set].line_[victim].dirty = lower_cache_ -> Extract(addr, replace_method);
+			else
+				lower_ -> HandleRequest(addr, CACHE_READ, replace_method);
+		}
 		++stats_.fetch_num;
 	}
 	else if ((read&1) == CACHE_WRITE) { // cache_write
 		if(config_.write_allocate == 0)
-			memory_ -> HandleRequest(addr, CACHE_WRITE, replace_method);
+			WbufWrite(addr, 1, replace_method);
 		else {
-			if(set_[addr_set].line_[victim].valid == 1) {
-				++stats_.replace_num;
-				if(set_[addr_set].line_[victim].dirty == 1) {
-					int tag_bit = config_.block_bit + config_.set_bit;
-					uint64_t victim_addr = (set_[addr_set].line_[victim].tag << tag_bit) | (addr_set << config_.block_bit);
-					// write back dirty
-					lower_ -> HandleRequest(victim_addr, CACHE_WRITE, replace_method);
-				}
-			}
+			Evict(addr_set, victim, replace_method);
 			// set cache info
 			set_[addr_set].line_[victim].valid = 1;
 			set_[addr_set].line_[victim].dirty = 1;
@@ -498,9 +782,757 @@ void Cache::ReplaceAlgorithm(uint64_t addr, int victim, uint64_t weight, int rea
 			set_[addr_set].line_[victim].weight = weight;
 			
 			// write cache
-			lower_ -> HandleRequest(addr, CACHE_WRITE, replace_method);
+			if (lower_exclusive_) // the block moves up, no copy is left below
+				lower_cache_ -> Extract(addr, replace_method);
+			else
+				lower_ -> HandleRequest(addr, CACHE_WRITE, replace_method);
 			++stats_.fetch_num;
 		}
 	}
 }
 
+
+void Cache::Evict(int addr_set, int victim, int replace_method)
+{
+	Line &line = set_[addr_set].line_[victim];
+
+	if (line.valid == 1) {
+		++stats_.replace_num;
+		ShipEvict(line);
+		if (config_.stream_num > 1) {
+			int owner = StreamOf(BlockAddr(line.tag, addr_set));
+			if (owner != stream_) {
+				++stream_stat_[stream_].inflict;
+				++stream_stat_[owner].suffer;
+			}
+		}
+		HEAT_COUNT(addr_set, line.tag, evict);
+		if (line.dirty == 1)
+			HEAT_COUNT(addr_set, line.tag, dirty_evict);
+		Spill(BlockAddr(line.tag, addr_set), line.dirty, line.sig, replace_method);
+	}
+}
+
+void Cache::Spill(uint64_t addr, int dirty, uint32_t sig, int replace_method)
+{
+	if (config_.victim_num == 0) {
+		Release(addr, dirty, replace_method);
+		return;
+	}
+
+	// invalid entry first, else the least recently inserted
+	int slot = 0;
+	for (int i = 0; i < config_.victim_num; ++i) {
+		if (!victim_[i].valid) {
+			slot = i;
+			break;
+		}
+		if (victim_[i].stamp < victim_[slot].stamp)
+			slot = i;
+	}
+	VictimLine &v = victim_[slot];
+	if (v.valid)
+		Release(v.block << config_.block_bit, v.dirty, replace_method);
+	v.valid = 1;
+	v.dirty = dirty;
+	v.block = addr >> config_.block_bit;
+	v.stamp = stats_.access_counter;
+	v.sig = sig;
+}
+
+void Cache::Release(uint64_t addr, int dirty, int replace_method)
+{
+	if (config_.inclusion == CACHE_INCLUSIVE && upper_ != NULL) {
+		int upper_block = upper_ -> config_.block_size;
+		for (uint64_t a = addr; a < addr + config_.block_size; a += upper_block)
+			dirty |= upper_ -> Invalidate(a);
+	}
+
+	if (lower_exclusive_)
+		lower_cache_ -> Insert(addr, dirty, replace_method);
+	else if (dirty)
+		// write back dirty
+		lower_ -> HandleRequest(addr, CACHE_WRITE, replace_method);
+}
+
+Storage *Cache::WriteThroughTarget()
+{
+	Cache *level = this;
+
+	while (level -> lower_exclusive_)
+		level = level -> lower_cache_;
+	return level -> lower_;
+}
+
+// Memory counts the writes that skip the last level, set sampling of the
+// last level must not scale them
+void Cache::WriteBelow(uint64_t addr, int to_memory, int replace_method)
+{
+	Storage *target = to_memory ? (Storage *) memory_ : WriteThroughTarget();
+
+	if (target == memory_ && lower_ != memory_)
+		memory_ -> HandleDirect(addr, CACHE_WRITE, replace_method);
+	else
+		target -> HandleRequest(addr, CACHE_WRITE, replace_method);
+}
+
+// Buffered writes drain through the detailed path, which is fine outside
+// the measured units
+void Cache::FastWriteBelow(uint64_t addr, int to_memory, int replace_method)
+{
+	if (config_.wbuf_num > 0)
+		WbufWrite(addr, to_memory, replace_method);
+	else if (to_memory)
+		memory_ -> FastForward(addr, CACHE_WRITE, replace_method);
+	else
+		WriteThroughTarget() -> FastForward(addr, CACHE_WRITE, replace_method);
+}
+
+// Without a buffer the write goes down at once, as before. A write to a
+// buffered block merges into its entry; when the buffer is full the oldest
+// entry drains first and the level stalls for the cycles it takes below
+void Cache::WbufWrite(uint64_t addr, int to_memory, int replace_method)
+{
+	uint64_t block = addr >> config_.block_bit;
+
+	if (config_.wbuf_num == 0) {
+		WriteBelow(addr, to_memory, replace_method);
+		return;
+	}
+	for (int i = 0; i < wbuf_cnt_; ++i)
+		if (wbuf_[i].block == block && wbuf_[i].to_memory == to_memory) {
+			++stats_.wbuf_merge_num;
+			return;
+		}
+
+	if (wbuf_cnt_ == config_.wbuf_num) {
+		StorageStats before, after;
+		Storage *oldest = wbuf_[0].to_memory ? (Storage *) memory_ : WriteThroughTarget();
+		oldest -> GetStats(before);
+		WbufDrain(0, replace_method);
+		oldest -> GetStats(after);
+		stats_.wbuf_stall_cycle += after.access_cycle - before.access_cycle;
+	}
+	WbufEntry &e = wbuf_[wbuf_cnt_++];
+	e.block = block;
+	e.stamp = stats_.access_counter;
+	e.to_memory = to_memory;
+}
+
+void Cache::WbufTick(int replace_method)
+{
+	while (wbuf_cnt_ > 0 && stats_.access_counter - wbuf_[0].stamp >= (uint64_t) config_.wbuf_timeout)
+		WbufDrain(0, replace_method);
+}
+
+void Cache::WbufMatch(uint64_t addr, int replace_method)
+{
+	uint64_t block = addr >> config_.block_bit;
+
+	for (int i = wbuf_cnt_ - 1; i >= 0; --i)
+		if (wbuf_[i].block == block)
+			WbufDrain(i, replace_method);
+}
+
+void Cache::WbufDrain(int i, int replace_method)
+{
+	WbufEntry e = wbuf_[i];
+
+	// remove first, the write below may come back up as a back-invalidation
+	memmove(wbuf_ + i, wbuf_ + i + 1, sizeof(WbufEntry) * (wbuf_cnt_ - i - 1));
+	--wbuf_cnt_;
+	++stats_.wbuf_drain_num;
+	WriteBelow(e.block << config_.block_bit, e.to_memory, replace_method);
+}
+
+void Cache::Flush(int replace_method)
+{
+	while (wbuf_cnt_ > 0)
+		WbufDrain(0, replace_method);
+	if (lower_cache_ != NULL)
+		lower_cache_ -> Flush(replace_method);
+}
+
+// PC of the access, or its address region when the trace has no PC;
+// one multiply spreads neighbouring values over the table
+uint32_t Cache::ShipSignature(uint64_t addr)
+{
+	uint64_t key = pc_ != 0 ? pc_ : addr >> SHIP_REGION_BIT;
+	return (uint32_t) ((key * 0x9E3779B97F4A7C15ULL) >> (64 - config_.ship_bits));
+}
+
+int Cache::ShipPredict(uint64_t addr)
+{
+	return shct_[ShipSignature(addr)] == 0;
+}
+
+// Predicted-dead misses go down untouched, except one in SHIP_SAMPLE that
+// is filled so its signature keeps training
+int Cache::ShipBypass(uint64_t addr, int addr_set, uint64_t addr_tag)
+{
+	if (Lookup(addr_set, addr_tag) != -1)
+		return FALSE;
+	if (config_.victim_num > 0 && VictimLookup(addr >> config_.block_bit) != -1)
+		return FALSE;
+	if (!ShipPredict(addr))
+		return FALSE;
+	return stats_.access_counter % SHIP_SAMPLE != 0;
+}
+
+void Cache::ShipFill(int addr_set, int victim, uint64_t addr, int replace_method)
+{
+	uint64_t addr_tag;
+	int fill_set;
+	Line *line = set_[addr_set].line_;
+
+	if (config_.ship_bits == 0)
+		return;
+	PartitionAlgorithm(addr, addr_tag, fill_set);
+	if (!line[victim].valid || line[victim].tag != addr_tag) // not allocated
+		return;
+
+	line[victim].sig = ShipSignature(addr);
+	line[victim].reused = 0;
+	line[victim].dead = shct_[line[victim].sig] == 0;
+	if (!line[victim].dead)
+		return;
+
+	// low insertion priority: first in line for eviction
+	if (replace_method == CACHE_RM_FIFO && !StampFifo()) {
+		Line fill = line[victim];
+		for (int j = victim; j > 0; --j)
+			line[j] = line[j-1];
+		line[0] = fill;
+	}
+	else if (replace_method != CACHE_RM_MRU && replace_method != CACHE_RM_RR
+	 && replace_method != CACHE_RM_LIFO) // MRU and LIFO evict new lines first anyway
+		line[victim].weight = 0;
+}
+
+void Cache::ShipHit(Line &line)
+{
+	if (config_.ship_bits == 0 || line.reused)
+		return;
+	line.reused = 1;
+	if (shct_[line.sig] < SHIP_MAX)
+		++shct_[line.sig];
+}
+
+void Cache::ShipEvict(Line &line)
+{
+	if (config_.ship_bits == 0)
+		return;
+	++stats_.pred_num;
+	if (line.dead == !line.reused)
+		++stats_.pred_hit_num;
+	if (!line.reused && shct_[line.sig] > 0)
+		--shct_[line.sig];
+}
+
+PcStat &Cache::PcStatOf(uint64_t pc)
+{
+	uint64_t h = (pc * 0x9E3779B97F4A7C15ULL) >> 52; // 12 bits
+
+	for (int probe = 0; probe < 8; ++probe) {
+		PcStat &slot = pc_stat_[(h + probe) & (PC_TABLE - 1)];
+		if (slot.pc == pc)
+			return slot;
+		if (slot.pc == 0) {
+			slot.pc = pc;
+			return slot;
+		}
+	}
+	return pc_stat_[PC_TABLE];
+}
+
+void Cache::PcClear()
+{
+	memset(pc_stat_, 0, sizeof(PcStat) * (PC_TABLE + 1));
+}
+
+void Cache::PrintPcStats()
+{
+	int top[PC_TOP];
+	int num = 0;
+
+	for (int i = 0; i < PC_TABLE; ++i) {
+		if (pc_stat_[i].pc == 0 || pc_stat_[i].miss == 0)
+			continue;
+		if (num < PC_TOP)
+			top[num++] = i;
+		else if (pc_stat_[i].miss > pc_stat_[top[PC_TOP-1]].miss)
+			top[PC_TOP-1] = i;
+		else
+			continue;
+		// most misses first
+		for (int j = num - 1; j > 0 && pc_stat_[top[j]].miss > pc_stat_[top[j-1]].miss; --j)
+			std::swap(top[j], top[j-1]);
+	}
+	if (num == 0)
+		return;
+
+	printf("Top miss PCs:\n");
+	for (int i = 0; i < num; ++i) {
+		PcStat &c = pc_stat_[top[i]];
+		printf("\t0x%lx\taccess: %lu\tmiss: %lu\t(%3.2f%%)\n", c.pc, c.access, c.miss,
+			100.0 * c.miss / c.access);
+	}
+	if (pc_stat_[PC_TABLE].access != 0)
+		printf("\tother\taccess: %lu\tmiss: %lu\n", pc_stat_[PC_TABLE].access, pc_stat_[PC_TABLE].miss);
+}
+
+void Cache::StreamClear()
+{
+	memset(stream_stat_, 0, sizeof(StreamStat) * MIX_STREAMS);
+}
+
+void Cache::PrintStreamStats()
+{
+	if (config_.stream_num <= 1)
+		return;
+
+	printf("Streams:\n");
+	for (int s = 0; s < config_.stream_num; ++s) {
+		StreamStat &c = stream_stat_[s];
+		printf("\t%d\taccess: %lu\tmiss: %lu\t(%3.2f%%)\tinflicted: %lu\tsuffered: %lu\n", s,
+			c.access, c.miss, c.access ? 100.0 * c.miss / c.access : 0, c.inflict, c.suffer);
+	}
+}
+
+int Cache::Lookup(int addr_set, uint64_t addr_tag)
+{
+	for (int i = 0; i < config_.associativity; ++i)
+		if (set_[addr_set].line_[i].valid && set_[addr_set].line_[i].tag == addr_tag)
+			return i;
+	return -1;
+}
+
+int Cache::VictimLookup(uint64_t block)
+{
+	for (int i = 0; i < config_.victim_num; ++i)
+		if (victim_[i].valid && victim_[i].block == block)
+			return i;
+	return -1;
+}
+
+// Victim cache hit: the block goes back into the set, the set's victim
+// takes its entry
+void Cache::VictimSwap(uint64_t addr, int victim, int vc, uint64_t weight, int read)
+{
+	uint64_t addr_tag;
+	int addr_set;
+
+	PartitionAlgorithm(addr, addr_tag, addr_set);
+	Line &line = set_[addr_set].line_[victim];
+	VictimLine &v = victim_[vc];
+	int dirty = v.dirty;
+	uint32_t sig = v.sig;
+
+	if (line.valid) {
+		ShipEvict(line); // leaves the set as in Evict()
+		v.block = BlockAddr(line.tag, addr_set) >> config_.block_bit;
+		v.dirty = line.dirty;
+		v.stamp = stats_.access_counter;
+		v.sig = line.sig;
+	}
+	else
+		v.valid = 0;
+
+	line.valid = 1;
+	line.dirty = dirty | (read == CACHE_WRITE && config_.write_through == 0);
+	line.tag = addr_tag;
+	line.weight = weight;
+	// hit in the victim cache, so it was reused: the fill's signature
+	// learns that, as a hit in the set would teach it
+	line.sig = sig;
+	line.reused = 0;
+	line.dead = 0;
+	ShipHit(line);
+	line.reused = 1;
+}
+
+int Cache::Extract(uint64_t addr, int replace_method)
+{
+	PROFILE_SCOPE(config_.level, PROF_HANDLE);
+	uint64_t addr_tag;
+	int addr_set;
+	int way, vc = -1;
+	int dirty = 0;
+
+	PartitionAlgorithm(addr, addr_tag, addr_set);
+	if (!set_sampled_[addr_set]) {
+		++stats_.skip_num;
+		return 0;
+	}
+	++stats_.access_counter;
+	stream_ = StreamOf(addr);
+	if (config_.stream_num > 1)
+		++stream_stat_[stream_].access;
+	HEAT_COUNT(addr_set, addr_tag, access);
+	stats_.access_cycle += latency_.bus_latency;
+	if (config_.index_hash == CACHE_IDX_SKEW)
+		SkewGather(addr_tag);
+
+	way = Lookup(addr_set, addr_tag);
+	if (way == -1 && config_.victim_num > 0)
+		vc = VictimLookup(addr >> config_.block_bit);
+	if (way >= 0) { // HIT, the line moves up
+		stats_.access_cycle += latency_.hit_latency;
+		dirty = set_[addr_set].line_[way].dirty;
+		set_[addr_set].line_[way].Init(CACHE_INVALID);
+	}
+	else if (vc >= 0) { // VICTIM HIT
+		++stats_.victim_hit_num;
+		stats_.access_cycle += latency_.hit_latency;
+		dirty = victim_[vc].dirty;
+		victim_[vc].valid = 0;
+	}
+	else { // MISS, fetched without allocating
+		++stats_.miss_num;
+		HEAT_COUNT(addr_set, addr_tag, miss);
+		if (config_.stream_num > 1)
+			++stream_stat_[stream_].miss;
+		++stats_.fetch_num;
+		if (lower_exclusive_)
+			dirty = lower_cache_ -> Extract(addr, replace_method);
+		else
+			lower_ -> HandleRequest(addr, CACHE_READ, replace_method);
+	}
+	if (config_.index_hash == CACHE_IDX_SKEW)
+		SkewScatter();
+	return dirty;
+}
+
+int Cache::FastExtract(uint64_t addr, int replace_method)
+{
+	uint64_t addr_tag;
+	int addr_set;
+	int way;
+	int dirty = 0;
+
+	PartitionAlgorithm(addr, addr_tag, addr_set);
+	if (!set_sampled_[addr_set])
+		return 0;
+	if (config_.index_hash == CACHE_IDX_SKEW)
+		SkewGather(addr_tag);
+
+	way = Lookup(addr_set, addr_tag);
+	if (way >= 0) {
+		dirty = set_[addr_set].line_[way].dirty;
+		set_[addr_set].line_[way].Init(CACHE_INVALID);
+	}
+	else if (lower_exclusive_)
+		dirty = lower_cache_ -> FastExtract(addr, replace_method);
+	else
+		lower_ -> FastForward(addr, CACHE_READ, replace_method);
+	if (config_.index_hash == CACHE_IDX_SKEW)
+		SkewScatter();
+	return dirty;
+}
+
+void Cache::Insert(uint64_t addr, int dirty, int replace_method)
+{
+	uint64_t addr_tag;
+	int addr_set;
+	int victim;
+	uint64_t weight;
+
+	PartitionAlgorithm(addr, addr_tag, addr_set);
+	if (!set_sampled_[addr_set])
+		return;
+	stream_ = StreamOf(addr);
+
+	if (config_.index_hash == CACHE_IDX_SKEW)
+		SkewGather(addr_tag);
+
+	Line *line = set_[addr_set].line_;
+	if (ReplaceDecision(addr, victim, weight, replace_method)) { // already here
+		line[victim].weight = weight;
+		line[victim].dirty |= dirty;
+	}
+	else {
+		if (config_.way_mask[stream_] != 0)
+			victim = WayQuotaVictim(addr_set, victim, replace_method);
+		Evict(addr_set, victim, replace_method);
+		line[victim].valid = 1;
+		line[victim].dirty = dirty;
+		line[victim].tag = addr_tag;
+		line[victim].weight = weight;
+		ShipFill(addr_set, victim, addr, replace_method);
+	}
+	if (config_.index_hash == CACHE_IDX_SKEW)
+		SkewScatter();
+}
+
+int Cache::Invalidate(uint64_t addr)
+{
+	uint64_t addr_tag;
+	int addr_set;
+	int way, vc = -1;
+	int dirty = 0;
+
+	PartitionAlgorithm(addr, addr_tag, addr_set);
+	if (config_.index_hash == CACHE_IDX_SKEW) {
+		// may arrive while this level's own access has the lines gathered,
+		// so drop the scratch copy too
+		Line *line = NULL;
+		for (int i = 0; i < config_.associativity && line == NULL; ++i) {
+			Line *l = &set_[SkewSet(addr_tag, i)].line_[i];
+			if (l -> valid && l -> tag == addr_tag)
+				line = l;
+		}
+		if (skew_active_) {
+			way = Lookup(addr_set, addr_tag);
+			if (way >= 0)
+				set_[addr_set].line_[way].Init(CACHE_INVALID);
+		}
+		way = line != NULL ? 0 : -1;
+		if (line != NULL) {
+			dirty = line -> dirty;
+			line -> Init(CACHE_INVALID);
+		}
+	}
+	else {
+		way = Lookup(addr_set, addr_tag);
+		if (way >= 0) {
+			dirty = set_[addr_set].line_[way].dirty;
+			set_[addr_set].line_[way].Init(CACHE_INVALID);
+		}
+	}
+	if (config_.victim_num > 0)
+		vc = VictimLookup(addr >> config_.block_bit);
+	if (way == -1 && vc == -1)
+		return 0;
+
+	++stats_.back_inval_num;
+	if (vc >= 0) {
+		dirty |= victim_[vc].dirty;
+		victim_[vc].valid = 0;
+	}
+	// inclusive of the level above too
+	if (config_.inclusion == CACHE_INCLUSIVE && upper_ != NULL) {
+		int upper_block = upper_ -> config_.block_size;
+		for (uint64_t a = addr; a < addr + config_.block_size; a += upper_block)
+			dirty |= upper_ -> Invalidate(a);
+	}
+	return dirty;
+}
+
+
+#define ARENA_ALIGN 64
+
+static size_t ArenaRound(size_t bytes)
+{
+	return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/*
+** One allocation holds every per-cache array, grouped by their reset value:
+**	[ Set | Line | pf_buf_info | set_sampled | victim | skew_slot | shct | pc_stat | heat ]
+**					zeroed on Reset(), shct then set to SHIP_INIT
+**	[ ghost keys | pf_buf ]		set to all-ones (no block) on Reset()
+*/
+bool Cache::InitArena()
+{
+	if (config_.pf_buf_num < 0) // unknown size, run without prefetching
+		config_.pf_buf_num = 0;
+
+	// largest prime <= set_num
+	prime_ = config_.set_num;
+	for (bool composite = true; prime_ > 2 && composite; ) {
+		composite = false;
+		for (int d = 2; d * d <= prime_; ++d)
+			if (prime_ % d == 0) {
+				composite = true;
+				--prime_;
+				break;
+			}
+	}
+
+	// one extra set: CACHE_IDX_SKEW gathers a block's candidate lines into it
+	size_t set_bytes = ArenaRound(sizeof(Set) * (config_.set_num + 1));
+	size_t line_bytes = ArenaRound(sizeof(Line) * (config_.set_num + 1) * config_.associativity);
+	size_t info_bytes = ArenaRound(sizeof(uint64_t) * config_.pf_buf_num);
+	size_t sampled_bytes = ArenaRound(config_.set_num + 1);
+	size_t victim_bytes = ArenaRound(sizeof(VictimLine) * config_.victim_num);
+	size_t wbuf_bytes = ArenaRound(sizeof(WbufEntry) * config_.wbuf_num);
+	size_t slot_bytes = ArenaRound(sizeof(Line *) * config_.associativity);
+	size_t shct_bytes = ArenaRound(config_.ship_bits > 0 ? (size_t) 1 << config_.ship_bits : 0);
+	size_t pc_bytes = ArenaRound(sizeof(PcStat) * (PC_TABLE + 1));
+	size_t stream_bytes = ArenaRound(sizeof(StreamStat) * MIX_STREAMS);
+	size_t heat_bytes = 0;
+#ifdef CACHE_HEATMAP
+	size_t set_heat_bytes = ArenaRound(sizeof(HeatCounter) * (config_.set_num + 1));
+	heat_bytes = set_heat_bytes + ArenaRound(sizeof(HeatRegion) * (HEAT_REGIONS + 1));
+#endif
+	size_t ghost_bytes = ArenaRound(sizeof(uint64_t) * (config_.set_num + 1) * ARC_GHOST_NUM * 2);
+	size_t buf_bytes = ArenaRound(sizeof(uint64_t) * config_.pf_buf_num * PF_BUF_DEPTH);
+
+	arena_ones_ = set_bytes + line_bytes + info_bytes + sampled_bytes + victim_bytes + wbuf_bytes
+		+ slot_bytes + shct_bytes + pc_bytes + stream_bytes + heat_bytes;
+	arena_size_ = arena_ones_ + ghost_bytes + buf_bytes;
+	if (posix_memalign((void **) &arena_, ARENA_ALIGN, arena_size_) != 0) {
+		arena_ = NULL;
+		return false;
+	}
+
+	set_ = (Set *) arena_;
+	pf_buf_info = (uint64_t *) (arena_ + set_bytes + line_bytes);
+	set_sampled_ = (uint8_t *) (arena_ + set_bytes + line_bytes + info_bytes);
+	victim_ = (VictimLine *) (arena_ + set_bytes + line_bytes + info_bytes + sampled_bytes);
+	wbuf_ = (WbufEntry *) ((char *) victim_ + victim_bytes);
+	skew_slot_ = (Line **) ((char *) wbuf_ + wbuf_bytes);
+	shct_ = (uint8_t *) skew_slot_ + slot_bytes;
+	pc_stat_ = (PcStat *) (shct_ + shct_bytes);
+	stream_stat_ = (StreamStat *) ((char *) pc_stat_ + pc_bytes);
+#ifdef CACHE_HEATMAP
+	set_heat_ = (HeatCounter *) ((char *) stream_stat_ + stream_bytes);
+	region_heat_ = (HeatRegion *) ((char *) set_heat_ + set_heat_bytes);
+#endif
+	pf_buf = (uint64_t (*)[PF_BUF_DEPTH]) (arena_ + arena_ones_ + ghost_bytes);
+	return true;
+}
+
+void Cache::Reset()
+{
+	Line *lines = (Line *) (arena_ + ArenaRound(sizeof(Set) * (config_.set_num + 1)));
+	uint64_t *ghost = (uint64_t *) (arena_ + arena_ones_);
+
+	memset(arena_, 0, arena_ones_);
+	memset(arena_ + arena_ones_, 0xFF, arena_size_ - arena_ones_);
+
+	// Line::Init(CACHE_INVALID) is all-zero, only the set headers need wiring
+	for (int i = 0; i <= config_.set_num; i++) {
+		set_[i].ARC_lim = config_.associativity / 2;
+		set_[i].line_ = lines + (size_t) i * config_.associativity;
+		set_[i].B1_list.Bind(ghost + (size_t) i * ARC_GHOST_NUM * 2);
+		set_[i].B2_list.Bind(ghost + (size_t) i * ARC_GHOST_NUM * 2 + ARC_GHOST_NUM);
+	}
+
+	if (config_.ship_bits > 0)
+		memset(shct_, SHIP_INIT, (size_t) 1 << config_.ship_bits);
+
+	SampleSets();
+	skew_active_ = 0;
+	wbuf_cnt_ = 0;
+	stream_ = 0;
+	pc_ = 0;
+	tid_ = 0;
+	rng_ = 0x9E3779B97F4A7C15ULL ^ (uint64_t) config_.level;
+	stats_ = StorageStats();
+	BypassClear();
+}
+
+// Keep sets whose hashed index has its top set_sample_shift bits clear,
+// which spreads the sample over the whole index range
+void Cache::SampleSets()
+{
+	int shift = config_.set_sample_shift;
+
+	sampled_sets_ = 0;
+	for (int i = 0; i < config_.set_num; i++) {
+		uint32_t h = (uint32_t) i * 0x9E3779B1u;
+		set_sampled_[i] = shift <= 0 || (h >> (32 - shift)) == 0;
+		sampled_sets_ += set_sampled_[i];
+	}
+	if (sampled_sets_ == 0) {
+		set_sampled_[0] = 1;
+		sampled_sets_ = 1;
+	}
+	// skewed caches are not set-sampled, every access maps to the scratch set
+	set_sampled_[config_.set_num] = 1;
+}
+
+double Cache::ExtrapolateStats()
+{
+	if (stats_.access_counter == 0 || stats_.skip_num == 0)
+		return 1.0;
+
+	double scale = (double) (stats_.access_counter + stats_.skip_num) / stats_.access_counter;
+	stats_.access_counter += stats_.skip_num;
+	stats_.miss_num = (uint64_t) (stats_.miss_num * scale + 0.5);
+	stats_.access_cycle = (uint64_t) (stats_.access_cycle * scale + 0.5);
+	stats_.replace_num = (uint64_t) (stats_.replace_num * scale + 0.5);
+	stats_.fetch_num = (uint64_t) (stats_.fetch_num * scale + 0.5);
+	stats_.prefetch_num = (uint64_t) (stats_.prefetch_num * scale + 0.5);
+	stats_.bypass_num = (uint64_t) (stats_.bypass_num * scale + 0.5);
+	stats_.back_inval_num = (uint64_t) (stats_.back_inval_num * scale + 0.5);
+	stats_.victim_hit_num = (uint64_t) (stats_.victim_hit_num * scale + 0.5);
+	stats_.pred_num = (uint64_t) (stats_.pred_num * scale + 0.5);
+	stats_.pred_hit_num = (uint64_t) (stats_.pred_hit_num * scale + 0.5);
+	stats_.wbuf_merge_num = (uint64_t) (stats_.wbuf_merge_num * scale + 0.5);
+	stats_.wbuf_drain_num = (uint64_t) (stats_.wbuf_drain_num * scale + 0.5);
+	stats_.wbuf_stall_cycle = (uint64_t) (stats_.wbuf_stall_cycle * scale + 0.5);
+	stats_.skip_num = 0;
+	return scale;
+}
+
+#ifdef CACHE_HEATMAP
+// Open addressing over HEAT_REGIONS slots, slot HEAT_REGIONS collects overflow
+HeatCounter &Cache::HeatRegionOf(uint64_t addr_tag)
+{
+	uint64_t key = (addr_tag >> config_.heat_shiftbit) + 1;
+	uint64_t h = (key * 0x9E3779B97F4A7C15ULL) >> 54; // 10 bits
+
+	for (int probe = 0; probe < 8; ++probe) {
+		HeatRegion &slot = region_heat_[(h + probe) & (HEAT_REGIONS - 1)];
+		if (slot.key == key)
+			return slot.cnt;
+		if (slot.key == 0) {
+			slot.key = key;
+			return slot.cnt;
+		}
+	}
+	return region_heat_[HEAT_REGIONS].cnt;
+}
+
+void Cache::HeatClear()
+{
+	memset(set_heat_, 0, sizeof(HeatCounter) * (config_.set_num + 1));
+	memset(region_heat_, 0, sizeof(HeatRegion) * (HEAT_REGIONS + 1));
+}
+
+void Cache::DumpHeatmap(FILE *csv, const char *policy, int level)
+{
+	for (int i = 0; i < config_.set_num; ++i) {
+		HeatCounter &c = set_heat_[i];
+		fprintf(csv, "%s,%d,set,%d,%lu,%lu,%lu,%lu\n", policy, level, i,
+			c.access, c.miss, c.evict, c.dirty_evict);
+	}
+	for (int i = 0; i <= HEAT_REGIONS; ++i) {
+		HeatRegion &r = region_heat_[i];
+		if (i < HEAT_REGIONS && r.key == 0)
+			continue;
+		if (i < HEAT_REGIONS)
+			fprintf(csv, "%s,%d,region,0x%lx,", policy, level, r.key - 1);
+		else if (r.cnt.access == 0)
+			continue;
+		else
+			fprintf(csv, "%s,%d,region,other,", policy, level);
+		fprintf(csv, "%lu,%lu,%lu,%lu\n", r.cnt.access, r.cnt.miss, r.cnt.evict, r.cnt.dirty_evict);
+	}
+}
+
+void Cache::PrintHeatmap()
+{
+	static const char shade[] = " .:-=+*#%@";
+	int width = config_.set_num < 64 ? config_.set_num : 64;
+	uint64_t max_miss = 0;
+
+	for (int i = 0; i < config_.set_num; ++i)
+		if (set_heat_[i].miss > max_miss)
+			max_miss = set_heat_[i].miss;
+
+	printf("Set miss heat map (%d sets, '@' = %lu misses):\n", config_.set_num, max_miss);
+	for (int i = 0; i < config_.set_num; i += width) {
+		printf("%6d |", i);
+		for (int j = i; j < i + width && j < config_.set_num; ++j)
+			putchar(max_miss ? shade[set_heat_[j].miss * 9 / max_miss] : ' ');
+		printf("|\n");
+	}
+}
+#else
+void Cache::HeatClear() {}
+void Cache::DumpHeatmap(FILE *csv, const char *policy, int level) {}
+void Cache::PrintHeatmap() {}
+#endif
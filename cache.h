@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <map>
 #include "storage.h"
 #include "memory.h"
@@ -13,6 +14,21 @@
 #define CACHE_INVALID	0x10
 #define CACHE_WB	0x11
 
+// Inclusion of the level above
+#define CACHE_NINE	0x0 // non-inclusive non-exclusive
+#define CACHE_INCLUSIVE	0x1 // evictions back-invalidate the level above
+#define CACHE_EXCLUSIVE	0x2 // filled only by the level above's evictions
+
+// Set index functions
+#define CACHE_IDX_MODULO	0x0 // the bits above the block offset
+#define CACHE_IDX_XOR	0x1 // upper address bits XOR-folded into the index
+#define CACHE_IDX_PRIME	0x2 // block number modulo the largest prime <= set_num
+#define CACHE_IDX_SKEW	0x3 // a different hash per way (skewed-associative)
+
+// Multi-programmed mixes: the stream id sits in the top address bits
+#define MIX_STREAMS	16
+#define MIX_TAG_BIT	56
+
 #define CACHE_READ	0x1
 #define CACHE_WRITE	0x0
 
@@ -30,6 +46,7 @@
 
 
 typedef struct CacheConfig_ {
+	int level; // 1 for the level next to the core
 	int size;
 	int associativity;
 	int set_num; // Number of cache sets
@@ -44,11 +61,32 @@ typedef struct CacheConfig_ {
 	double bypass_threshold;
 
 	int pf_buf_num;
+
+	int heat_shiftbit; // region = addr_tag >> heat_shiftbit (CACHE_HEATMAP)
+
+	int set_sample_shift; // simulate ~1/2^shift of the sets, 0 for all
+
+	int inclusion; // CACHE_NINE | CACHE_INCLUSIVE | CACHE_EXCLUSIVE
+	int victim_num; // fully associative victim cache entries, 0 for none
+
+	int index_hash; // CACHE_IDX_*, tags hold the whole block number unless MODULO
+
+	int ship_bits; // log2 reuse predictor entries, 0 for no predictor
+	int ship_bypass; // 1: predicted-dead fills bypass, 0: inserted at low priority
+
+	int wbuf_num; // coalescing write buffer entries for write-through writes, 0 for none
+	int wbuf_timeout; // drain an entry this many accesses after it was filled, 0: only when full
+
+	int stream_num; // streams in a mixed trace, per-stream stats when > 1
+	uint32_t way_mask[MIX_STREAMS]; // ways each stream may fill, 0 for all
 } CacheConfig;
 
 typedef struct Line_ {
-	int dirty;
-	int valid;
+	uint8_t dirty;
+	uint8_t valid;
+	uint8_t reused; // hit since filled (reuse predictor)
+	uint8_t dead; // predicted dead when filled
+	uint32_t sig; // predictor signature of the fill
 	uint64_t tag;
 	uint64_t weight;
 	
@@ -66,6 +104,9 @@ typedef struct Line_ {
 		if (init_type == CACHE_INVALID) {
 			valid = 0;
 			dirty = 0;
+			reused = 0;
+			dead = 0;
+			sig = 0;
 			weight = 0;
 			tag = 0;
 		}
@@ -75,6 +116,54 @@ typedef struct Line_ {
 	}
 } Line;
 
+// Victim cache entry, holds a whole block evicted from the sets
+typedef struct VictimLine_ {
+	int dirty;
+	int valid;
+	uint64_t block; // addr >> block_bit
+	uint64_t stamp; // access_counter when inserted, LRU
+	uint32_t sig; // predictor signature of the fill into the set
+} VictimLine;
+
+// Write buffer entry, one block with any number of merged writes
+#define WBUF_TIMEOUT	64 // default drain timer in accesses of the level
+
+typedef struct WbufEntry_ {
+	uint64_t block; // addr >> block_bit
+	uint64_t stamp; // access_counter when filled
+	int to_memory; // no-allocate write miss, drains to main memory
+} WbufEntry;
+
+// Per-PC access/miss counts, open addressing with one overflow slot
+#define PC_TABLE	4096 // tracked PCs, power of 2
+#define PC_TOP	10 // PCs listed by PrintPcStats()
+
+typedef struct PcStat_ {
+	uint64_t pc; // 0 for a free slot
+	uint64_t access;
+	uint64_t miss;
+} PcStat;
+
+// Per-stream counts of a mixed trace
+typedef struct StreamStat_ {
+	uint64_t access;
+	uint64_t miss;
+	uint64_t inflict; // lines of other streams its fills evicted
+	uint64_t suffer; // its lines evicted by other streams' fills
+} StreamStat;
+
+// Reuse predictor: 3-bit counters per signature, 0 predicts a dead fill
+#define SHIP_MAX	7
+#define SHIP_INIT	1
+#define SHIP_REGION_BIT	14 // signature region when the trace has no PC: 16KB
+#define SHIP_SAMPLE	32 // one predicted-dead fill in SHIP_SAMPLE is kept for training
+
+#define ARC_GHOST_NUM	8
+#define PF_BUF_DEPTH	4
+
+// ARC ghost list. Unused slots hold all-ones, which is no block's tag; the
+// lists used to start from uninitialised heap memory, in practice zeros,
+// so a block with tag 0 counted as a ghost hit
 struct RR_queue {
 	int head, items;
 	uint64_t *keys;
@@ -88,16 +177,23 @@ struct RR_queue {
 
 	bool empty()
 	{
-		return keys == NULL;
+		return items == 0;
+	}
+
+	// Attach to ARC_GHOST_NUM keys owned by the cache arena
+	void Bind(uint64_t *buf)
+	{
+		keys = buf;
+		head = 0;
+		items = 0;
 	}
 
 	void Init(int len)
 	{
-		if (len <= 0) {
+		if (len <= 0 || len > ARC_GHOST_NUM || keys == NULL) {
 			puts("Invalid RR_queue length!");
 			throw;
 		}
-		keys = new uint64_t[len];
 
 		head = 0;
 		items = len;
@@ -126,12 +222,12 @@ typedef struct Set_{
 
 	void B1_push(int x)
 	{
-		if (B1_list.empty()) B1_list.Init(8);
+		if (B1_list.empty()) B1_list.Init(ARC_GHOST_NUM);
 		B1_list.push(line_[x].tag);
 	}
 	void B2_push(int x)
 	{
-		if (B2_list.empty()) B2_list.Init(8);
+		if (B2_list.empty()) B2_list.Init(ARC_GHOST_NUM);
 		B2_list.push(line_[x].tag);
 	}
 
@@ -147,6 +243,30 @@ typedef struct Set_{
 	}
 } Set;
 
+#ifdef CACHE_HEATMAP
+#define HEAT_REGIONS	1024 // tracked regions, the rest share one overflow slot
+
+typedef struct HeatCounter_ {
+	uint64_t access;
+	uint64_t miss;
+	uint64_t evict;
+	uint64_t dirty_evict;
+} HeatCounter;
+
+typedef struct HeatRegion_ {
+	uint64_t key; // region + 1, 0 for a free slot
+	HeatCounter cnt;
+} HeatRegion;
+
+#define HEAT_COUNT(addr_set, addr_tag, field) \
+	do { \
+		++set_heat_[addr_set].field; \
+		++HeatRegionOf(addr_tag).field; \
+	} while (0)
+#else
+#define HEAT_COUNT(addr_set, addr_tag, field) do { } while (0)
+#endif
+
 class Cache: public Storage {
 private:
 	// Bypassing
@@ -155,7 +275,18 @@ private:
 	void BypassUpdatestat(uint64_t addr_tag, int victim);
 	// Partitioning
 	void PartitionAlgorithm(uint64_t addr, uint64_t &addr_tag, int &addr_set);
+	// Address of the block in a line, inverse of PartitionAlgorithm
+	uint64_t BlockAddr(uint64_t tag, int addr_set);
+	// Skewed-associative: way's set for block, and the candidate lines
+	// copied into the scratch set (index set_num) and back
+	int SkewSet(uint64_t block, int way);
+	void SkewGather(uint64_t block);
+	void SkewScatter();
+	// FIFO/LIFO by insertion time instead of way order: skewed sets, way quotas
+	bool StampFifo() { return config_.index_hash == CACHE_IDX_SKEW || config_.way_mask[0] != 0; }
+	int StampFifoDecision(int addr_set, uint64_t addr_tag, int &victim, uint64_t &weight, int replace_method);
 	// Replacement
+	int LeastWeight(int addr_set);
 	int ReplaceDecision(uint64_t addr, int &victim, uint64_t &weight, int replace_method);
 	// Replace Algorithms
 	void ReplaceAlgorithm(uint64_t addr, int victim, uint64_t weight, int read, int replace_method);
@@ -163,16 +294,124 @@ private:
 	int PrefetchDecision(uint64_t addr, int &vicbuf);
 	void PrefetchAlgorithm(uint64_t addr, int vicbuf);
 
+	// Way partitioning: victim within the stream's ways
+	int WayQuotaVictim(int addr_set, int victim, int replace_method);
+	int StreamOf(uint64_t addr) { return (int) (addr >> MIX_TAG_BIT) & (MIX_STREAMS - 1); }
+
+	// Per-PC stats slot, overflow slot when the table is full
+	PcStat &PcStatOf(uint64_t pc);
+
+	// Reuse predictor
+	uint32_t ShipSignature(uint64_t addr);
+	// 1 if a fill of addr is predicted dead
+	int ShipPredict(uint64_t addr);
+	// 1 if the access misses and its fill should bypass
+	int ShipBypass(uint64_t addr, int addr_set, uint64_t addr_tag);
+	// Fill of line victim: record signature, demote it if predicted dead
+	void ShipFill(int addr_set, int victim, uint64_t addr, int replace_method);
+	void ShipHit(Line &line);
+	void ShipEvict(Line &line);
+
+	// Inclusion & victim cache
+	int Lookup(int addr_set, uint64_t addr_tag);
+	int VictimLookup(uint64_t block);
+	void VictimSwap(uint64_t addr, int victim, int vc, uint64_t weight, int read);
+	// A valid line leaves the set: count it and pass it on
+	void Evict(int addr_set, int victim, int replace_method);
+	// Block leaves the set, into the victim cache if there is one
+	void Spill(uint64_t addr, int dirty, uint32_t sig, int replace_method);
+	// Block leaves the level
+	void Release(uint64_t addr, int dirty, int replace_method);
+	// Where a write-through of a block held here goes: past the exclusive
+	// levels below, which keep no copy of it
+	Storage *WriteThroughTarget();
+
+	// Write-through (or no-allocate write to memory) leaving this level
+	void WriteBelow(uint64_t addr, int to_memory, int replace_method);
+	// Same for fast-forwarding, through the write buffer if there is one
+	void FastWriteBelow(uint64_t addr, int to_memory, int replace_method);
+	// Write buffer: write-through writes go down through it
+	void WbufWrite(uint64_t addr, int to_memory, int replace_method);
+	// Drain entries older than wbuf_timeout
+	void WbufTick(int replace_method);
+	// A read going down drains a buffered write to the same block first
+	void WbufMatch(uint64_t addr, int replace_method);
+	void WbufDrain(int i, int replace_method);
+
+	// Arena layout
+	// false if the arena cannot be allocated, arena_ is then NULL
+	bool InitArena();
+	// Set sampling selection
+	void SampleSets();
+#ifdef CACHE_HEATMAP
+	HeatCounter &HeatRegionOf(uint64_t addr_tag);
+#endif
+
 	CacheConfig config_;
 	Storage *lower_;
 	Memory *memory_;
 	Set *set_;
 
+	// Neighbouring cache levels, NULL at the ends of the hierarchy
+	Cache *upper_;
+	Cache *lower_cache_;
+	int lower_exclusive_;
+
+	// Victim cache, config_.victim_num entries
+	VictimLine *victim_;
+
+	// Write buffer, oldest first, config_.wbuf_num entries
+	WbufEntry *wbuf_;
+	int wbuf_cnt_;
+
+	// Reuse predictor counters, 1 << ship_bits entries
+	uint8_t *shct_;
+
+	// Extended trace fields of the access being simulated, see Access()
+	uint64_t pc_;
+	int tid_;
+	PcStat *pc_stat_; // PC_TABLE + 1 entries
+
+	// Stream of the access being simulated, and per-stream counts
+	int stream_;
+	StreamStat *stream_stat_; // MIX_STREAMS entries
+
+	// RR victims: xorshift64*, seeded per level on Reset(), so a run does
+	// not depend on other caches or threads sharing rand()
+	uint64_t rng_;
+	uint32_t Random()
+	{
+		rng_ ^= rng_ >> 12;
+		rng_ ^= rng_ << 25;
+		rng_ ^= rng_ >> 27;
+		return (uint32_t) ((rng_ * 0x2545F4914F6CDD1DULL) >> 32);
+	}
+
+	// Set index hashing
+	int prime_; // CACHE_IDX_PRIME modulus
+	Line **skew_slot_; // CACHE_IDX_SKEW: where each scratch line came from
+	int skew_active_; // scratch set holds gathered lines
+
 	// Bypass storage
 	std::map<uint64_t, int> bypass_cnt, bypass_miss;
 
 	// Prefetch buffer
-	uint64_t **pf_buf, *pf_buf_info;
+	uint64_t (*pf_buf)[PF_BUF_DEPTH], *pf_buf_info;
+
+	// Set sampling: 1 for sets that are simulated
+	uint8_t *set_sampled_;
+	int sampled_sets_;
+
+#ifdef CACHE_HEATMAP
+	// Heat map counters, per set and per address region
+	HeatCounter *set_heat_;
+	HeatRegion *region_heat_;
+#endif
+
+	// All per-cache state lives in one aligned block, see InitArena()
+	char *arena_;
+	size_t arena_size_;
+	size_t arena_ones_; // offset of the region reset to all-ones
 	
 	DISALLOW_COPY_AND_ASSIGN(Cache);
 
@@ -189,31 +428,48 @@ public:
 		SetLower(lower);
 		memory_ = memory;
 		latency_ = latency;
-		
-		set_ = new Set[config_.set_num];
-		for (int i = 0; i < config_.set_num; i++) {
-			set_[i].ARC_lim = config.associativity / 2;
-			set_[i].line_ = new Line[config_.associativity];
-			for (int j = 0; j < config_.associativity; j++) {
-				set_[i].line_[j].Init(CACHE_INVALID);
-			}
-		}
-		
-		BypassClear();
 
-		pf_buf = new uint64_t*[config_.pf_buf_num];
-		pf_buf_info = new uint64_t[config_.pf_buf_num];
-		for (int i = 0; i < config_.pf_buf_num; ++i) {
-			pf_buf[i] = new uint64_t[4];
+		// link to the level below, which sends back-invalidations up
+		upper_ = NULL;
+		lower_cache_ = dynamic_cast<Cache *>(lower);
+		lower_exclusive_ = 0;
+		if (lower_cache_ != NULL) {
+			lower_cache_ -> upper_ = this;
+			lower_exclusive_ = lower_cache_ -> config_.inclusion == CACHE_EXCLUSIVE;
+		}
+		// bypassed fills would break inclusion
+		if (config_.inclusion == CACHE_INCLUSIVE) {
+			config_.bypass_shiftbit = -1;
+			config_.ship_bypass = 0;
 		}
+		
+		if (InitArena())
+			Reset();
 	}
 	
 	~Cache() 
 	{
-		for (int i = 0; i < config_.set_num; i++)
-			delete[] set_[i].line_;
-		delete[] set_;
+		free(arena_);
 	}
+
+	// State allocated; a Cache without it must only be deleted
+	bool Allocated() { return arena_ != NULL; }
+
+	// Invalidate every line and drop stats, prefetch and bypass history
+	void Reset();
+
+	// Set sampling
+	void SetSetSampling(int shift) { config_.set_sample_shift = shift; SampleSets(); }
+	int SampledSets() { return sampled_sets_; }
+	// Scale stats from the sampled sets up to the whole cache, returns the factor
+	double ExtrapolateStats();
+
+	// Heat map, no-ops unless built with CACHE_HEATMAP
+	void HeatClear();
+	// CSV rows: policy,level,kind(set|region),index,access,miss,evict,dirty_evict
+	void DumpHeatmap(FILE *csv, const char *policy, int level);
+	// Per-set miss heat as a character grid on stdout
+	void PrintHeatmap();
 	
 	// Sets & Gets
 	void SetConfig(CacheConfig config) { config_ = config; }
@@ -221,6 +477,41 @@ public:
 	void SetLower(Storage *lower) { lower_ = lower; }
 
 	void HandleRequest(uint64_t addr, int read, int replace_method);
+	void FastForward(uint64_t addr, int read, int replace_method);
+
+	// Trace access: PC and thread id are set for every level below, then
+	// an access crossing block boundaries is split into block requests.
+	// size 0 and pc 0 when the trace does not have them
+	void Access(uint64_t addr, uint32_t size, int read, int replace_method, uint64_t pc, int tid);
+	// Same split for fast-forwarding
+	void FastAccess(uint64_t addr, uint32_t size, int read, int replace_method);
+	void SetContext(uint64_t pc, int tid)
+	{
+		pc_ = pc;
+		tid_ = tid;
+		if (lower_cache_ != NULL)
+			lower_cache_ -> SetContext(pc, tid);
+	}
+	void PcClear();
+	// Top PCs by misses, nothing if the trace has no PCs
+	void PrintPcStats();
+	void StreamClear();
+	// Nothing unless the trace is a mix of streams
+	void PrintStreamStats();
+	void GetStreamStats(int stream, StreamStat &ss) { ss = stream_stat_[stream]; }
+
+	// Drain the write buffers of this level and every level below
+	void Flush(int replace_method);
+
+	// Exclusive level: fill for the level above, the block moves up.
+	// Returns 1 if the block was dirty here
+	int Extract(uint64_t addr, int replace_method);
+	// Same for fast-forwarding, without stats
+	int FastExtract(uint64_t addr, int replace_method);
+	// Exclusive level: block evicted by the level above
+	void Insert(uint64_t addr, int dirty, int replace_method);
+	// Inclusive level below dropped the block, returns 1 if it was dirty here
+	int Invalidate(uint64_t addr);
 };
 
 #endif //CACHE_CACHE_H_ 
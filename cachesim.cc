@@ -0,0 +1,162 @@
+#include <stddef.h>
+#include <string.h>
+#include <new>
+#include "cachesim.h"
+#include "cache.h"
+#include "memory.h"
+#include "hierarchy.h"
+
+struct cachesim {
+	int level;
+	int replace_method;
+	Cache *cache[CACHESIM_MAX_LEVELS + 1]; // 1-based
+	Memory memory;
+};
+
+int cachesim_api_version(void)
+{
+	return CACHESIM_API_VERSION;
+}
+
+static bool Bad_replace_method(int replace_method)
+{
+	return replace_method < CACHE_RM_LRU || replace_method > CACHE_RM_LIFO;
+}
+
+int cachesim_replace_method(const char *name)
+{
+	int RM = name == NULL ? -1 : Lookup_name(name);
+	return Bad_replace_method(RM) ? -1 : RM;
+}
+
+// Same defaults as sim: size-class latencies and prefetch buffers, bypass
+// on BYPASS_SET levels
+cachesim_t *cachesim_create(const cachesim_config *config)
+{
+	if (config == NULL || config -> levels < 1 || config -> levels > CACHESIM_MAX_LEVELS)
+		return NULL;
+	if (Bad_replace_method(config -> replace_method))
+		return NULL;
+	if (config -> inclusion < CACHESIM_NINE || config -> inclusion > CACHESIM_EXCLUSIVE)
+		return NULL;
+
+	CacheConfig cc[CACHESIM_MAX_LEVELS + 1];
+	StorageLatency latency[CACHESIM_MAX_LEVELS + 1];
+	for (int i = 1; i <= config -> levels; ++i) {
+		const cachesim_level_config &lc = config -> level[i-1];
+		if (lc.index_hash < CACHESIM_IDX_MODULO || lc.index_hash > CACHESIM_IDX_SKEW
+		 || lc.ship_bits < 0 || lc.ship_bits > 24 || lc.victim_num < 0 || lc.wbuf_num < 0)
+			return NULL;
+		if (Bad_geometry(lc.size_kb, lc.associativity, lc.block_size, lc.index_hash))
+			return NULL;
+		Make_config(cc[i], i, lc.size_kb, lc.associativity, lc.block_size, lc.write_through != 0);
+		latency[i] = Default_latency(lc.size_kb);
+		cc[i].inclusion = i > 1 ? config -> inclusion : CACHE_NINE;
+		cc[i].victim_num = lc.victim_num;
+		cc[i].index_hash = lc.index_hash;
+		cc[i].ship_bits = lc.ship_bits;
+		cc[i].wbuf_num = lc.wbuf_num;
+		cc[i].wbuf_timeout = config -> wbuf_timeout > 0 ? config -> wbuf_timeout : 0;
+		Default_bypass(cc[i]);
+	}
+
+	cachesim_t *sim = new (std::nothrow) cachesim;
+	if (sim == NULL)
+		return NULL;
+	sim -> level = config -> levels;
+	sim -> replace_method = config -> replace_method;
+	for (int i = 0; i <= CACHESIM_MAX_LEVELS; ++i)
+		sim -> cache[i] = NULL;
+	for (int i = sim -> level; i >= 1; i--) {
+		Storage *lower = i == sim -> level ? (Storage *) &sim -> memory : sim -> cache[i+1];
+		sim -> cache[i] = new (std::nothrow) Cache(cc[i], lower, &sim -> memory, latency[i]);
+		if (sim -> cache[i] == NULL || !sim -> cache[i] -> Allocated()) {
+			cachesim_destroy(sim);
+			return NULL;
+		}
+	}
+	return sim;
+}
+
+void cachesim_destroy(cachesim_t *sim)
+{
+	if (sim == NULL)
+		return;
+	for (int i = 1; i <= sim -> level; ++i)
+		delete sim -> cache[i];
+	delete sim;
+}
+
+void cachesim_access(cachesim_t *sim, uint64_t addr, uint32_t size, int read, uint64_t pc)
+{
+	sim -> cache[1] -> Access(addr, size, read != CACHESIM_WRITE, sim -> replace_method, pc, 0);
+}
+
+void cachesim_access_batch(cachesim_t *sim, const cachesim_record *recs, size_t num)
+{
+	Cache *l1 = sim -> cache[1];
+	int RM = sim -> replace_method;
+
+	for (size_t j = 0; j < num; ++j)
+		l1 -> Access(recs[j].addr, recs[j].size, recs[j].type == 'r', RM, recs[j].pc, recs[j].tid);
+}
+
+void cachesim_flush(cachesim_t *sim)
+{
+	sim -> cache[1] -> Flush(sim -> replace_method);
+}
+
+// Filled in a full struct, then only the caller's stats -> size bytes are
+// copied out, so a caller built against an older header gets a prefix
+int cachesim_get_stats(cachesim_t *sim, int level, cachesim_stats *stats)
+{
+	StorageStats ss;
+	cachesim_stats out;
+
+	if (level < 0 || level > sim -> level || stats == NULL)
+		return -1;
+	if (stats -> size < offsetof(cachesim_stats, access_counter))
+		return -1;
+	if (level == 0)
+		sim -> memory.GetStats(ss);
+	else
+		sim -> cache[level] -> GetStats(ss);
+
+	out.size = stats -> size;
+	out.access_counter = ss.access_counter;
+	out.miss_num = ss.miss_num;
+	out.access_cycle = ss.access_cycle;
+	out.replace_num = ss.replace_num;
+	out.fetch_num = ss.fetch_num;
+	out.prefetch_num = ss.prefetch_num;
+	out.bypass_num = ss.bypass_num;
+	out.back_inval_num = ss.back_inval_num;
+	out.victim_hit_num = ss.victim_hit_num;
+	out.pred_num = ss.pred_num;
+	out.pred_hit_num = ss.pred_hit_num;
+	out.wbuf_merge_num = ss.wbuf_merge_num;
+	out.wbuf_drain_num = ss.wbuf_drain_num;
+	out.wbuf_stall_cycle = ss.wbuf_stall_cycle;
+	memcpy(stats, &out, stats -> size < sizeof(out) ? stats -> size : sizeof(out));
+	return 0;
+}
+
+// As sim does between warm-up and measurement
+void cachesim_clear_stats(cachesim_t *sim)
+{
+	StorageStats zerostats;
+
+	sim -> memory.SetStats(zerostats);
+	for (int i = 1; i <= sim -> level; ++i) {
+		sim -> cache[i] -> SetStats(zerostats);
+		sim -> cache[i] -> BypassClear();
+		sim -> cache[i] -> PcClear();
+	}
+}
+
+void cachesim_reset(cachesim_t *sim)
+{
+	sim -> memory.Reset();
+	for (int i = 1; i <= sim -> level; ++i)
+		sim -> cache[i] -> Reset();
+}
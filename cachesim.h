@@ -0,0 +1,123 @@
+#ifndef CACHE_CACHESIM_H_
+#define CACHE_CACHESIM_H_
+
+/*
+** libcachesim: the cache/memory core behind a C API, for driving the
+** simulator in-process. Link with -lcachesim (libcachesim.a or .so).
+**
+**	cachesim_config config = { 0 };
+**	config.levels = 2;
+**	config.level[0].size_kb = 32; ... // associativity, block_size
+**	config.replace_method = cachesim_replace_method("LRU");
+**	cachesim_t *sim = cachesim_create(&config);
+**	cachesim_access(sim, addr, 8, CACHESIM_READ, pc);
+**	cachesim_stats stats = { sizeof(stats) };
+**	cachesim_get_stats(sim, 1, &stats);
+**	cachesim_destroy(sim);
+**
+** A handle is not thread-safe, separate handles are independent.
+** Structs only grow at the end; callers zero them before filling. Structs
+** the library writes start with their size as the caller compiled them.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CACHESIM_API_VERSION	1
+#define CACHESIM_MAX_LEVELS	3
+
+#define CACHESIM_WRITE	0
+#define CACHESIM_READ	1
+
+// inclusion of each level below L1
+#define CACHESIM_NINE	0
+#define CACHESIM_INCLUSIVE	1
+#define CACHESIM_EXCLUSIVE	2
+
+// set index functions
+#define CACHESIM_IDX_MODULO	0
+#define CACHESIM_IDX_XOR	1
+#define CACHESIM_IDX_PRIME	2
+#define CACHESIM_IDX_SKEW	3
+
+typedef struct cachesim_level_config {
+	int size_kb;
+	int associativity;
+	int block_size; // bytes, power of 2
+	int write_through; // 0|1 for back|through
+	int victim_num; // victim cache entries, 0 for none
+	int index_hash; // CACHESIM_IDX_*, PRIME also takes non-power-of-2 set counts
+	int ship_bits; // log2 reuse predictor entries, 0 for none
+	int wbuf_num; // write buffer entries, 0 for none
+} cachesim_level_config;
+
+typedef struct cachesim_config {
+	int levels; // 1..CACHESIM_MAX_LEVELS
+	cachesim_level_config level[CACHESIM_MAX_LEVELS]; // level[0] is L1
+	int inclusion; // CACHESIM_NINE | CACHESIM_INCLUSIVE | CACHESIM_EXCLUSIVE
+	int replace_method; // from cachesim_replace_method()
+	int wbuf_timeout; // write buffer drain timer in accesses, 0 only when full
+} cachesim_config;
+
+// One access; the library reads the fields, not a sim trace record
+typedef struct cachesim_record {
+	uint64_t addr;
+	uint64_t pc; // 0 if unknown
+	uint32_t size; // bytes, 0 or 1 for a single block
+	uint16_t tid;
+	char type; // 'r' | 'w'
+} cachesim_record;
+
+typedef struct cachesim_stats {
+	size_t size; // sizeof(cachesim_stats), set by the caller
+	uint64_t access_counter;
+	uint64_t miss_num;
+	uint64_t access_cycle;
+	uint64_t replace_num;
+	uint64_t fetch_num;
+	uint64_t prefetch_num;
+	uint64_t bypass_num;
+	uint64_t back_inval_num;
+	uint64_t victim_hit_num;
+	uint64_t pred_num;
+	uint64_t pred_hit_num;
+	uint64_t wbuf_merge_num;
+	uint64_t wbuf_drain_num;
+	uint64_t wbuf_stall_cycle;
+} cachesim_stats;
+
+typedef struct cachesim cachesim_t;
+
+int cachesim_api_version(void);
+// Replace method id by name ("LRU", "ARC", ...), -1 if unknown or not
+// supported by the library
+int cachesim_replace_method(const char *name);
+
+// NULL if the config is invalid or the levels cannot be allocated
+cachesim_t *cachesim_create(const cachesim_config *config);
+void cachesim_destroy(cachesim_t *sim);
+
+// One access; split per block when it crosses block boundaries
+void cachesim_access(cachesim_t *sim, uint64_t addr, uint32_t size, int read, uint64_t pc);
+// num records from the caller's buffer
+void cachesim_access_batch(cachesim_t *sim, const cachesim_record *recs, size_t num);
+
+// Drain write buffers into the levels below
+void cachesim_flush(cachesim_t *sim);
+// Stats of cache level 1..levels, 0 for main memory, at most stats -> size
+// bytes written; -1 for a bad level or size
+int cachesim_get_stats(cachesim_t *sim, int level, cachesim_stats *stats);
+// Zero the stats, keep the contents (end of warm-up)
+void cachesim_clear_stats(cachesim_t *sim);
+// Empty every level and zero the stats
+void cachesim_reset(cachesim_t *sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CACHE_CACHESIM_H_
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "hierarchy.h"
+
+// Size classes, the 32KB and 256KB rows are the original L1/L2 numbers
+typedef struct SizeClass_ {
+	int max_kb;
+	uint64_t bus_latency;
+	uint64_t hit_latency;
+	int pf_buf_num;
+} SizeClass;
+
+static const SizeClass size_class[] = {
+	{ 32, 0, 3, 64 },
+	{ 256, 6, 4, 1024 },
+	{ 2048, 12, 10, 4096 },
+	{ 1 << 30, 20, 16, 4096 },
+};
+
+static const SizeClass &Class_of(int size_kb)
+{
+	int i = 0;
+	while (size_kb > size_class[i].max_kb)
+		++i;
+	return size_class[i];
+}
+
+StorageLatency Default_latency(int size_kb)
+{
+	const SizeClass &c = Class_of(size_kb);
+	return StorageLatency(c.bus_latency, c.hit_latency);
+}
+
+int Default_pf_buf_num(int size_kb)
+{
+	return Class_of(size_kb).pf_buf_num;
+}
+
+int ilog2(int x)
+{
+	int res = 0;
+	while(x >>= 1)
+		++res;
+	return res;
+}
+
+bool Bad_geometry(int size_kb, int associativity, int block_size, int index_hash)
+{
+	if (size_kb <= 0 || associativity <= 0 || block_size <= 0)
+		return true;
+	if (block_size & (block_size - 1))
+		return true;
+	int64_t set_num = (1LL << 10) * size_kb / ((int64_t) associativity * block_size);
+	if (set_num <= 0 || set_num * associativity * block_size != (1LL << 10) * size_kb)
+		return true;
+	return index_hash != CACHE_IDX_PRIME && (set_num & (set_num - 1)) != 0;
+}
+
+void Make_config(CacheConfig &config, int level, int size_kb, int associativity,
+	int block_size, int write_through)
+{
+	memset(&config, 0, sizeof(config));
+	config.level = level;
+	config.size = (1LL << 10) * size_kb;
+	config.associativity = associativity;
+	config.block_size = block_size;
+	config.write_through = write_through;
+	config.write_allocate = 1 - write_through;
+	config.set_num = config.size / (config.associativity * config.block_size);
+	config.block_bit = ilog2(config.block_size);
+	config.set_bit = ilog2(config.set_num);
+	config.pf_buf_num = Default_pf_buf_num(size_kb);
+	config.bypass_shiftbit = -1;
+}
+
+void Default_bypass(CacheConfig &config)
+{
+	if ((BYPASS_SET >> config.level)&1) {
+		config.bypass_shiftbit = BYPASS_SHIFTBIT;
+		config.bypass_threshold = BYPASS_THRESHOLD;
+	}
+	else {
+		config.bypass_shiftbit = -1;
+	}
+}
+
+void Check_allocated(Cache *cache, int level)
+{
+	if (cache -> Allocated())
+		return;
+	printf("Error 2:\n");
+	printf("Cannot allocate the state of the level %d cache\n", level);
+	throw;
+}
+
+const char * Retrieve_name(int replace_method)
+{
+	const char *res = NULL;
+	switch (replace_method)
+	{
+		case 0x20: res = "LRU"; break;
+		case 0x21: res = "MRU"; break;
+		case 0x22: res = "RR"; break;
+		case 0x23: res = "SLRU"; break;
+		case 0x24: res = "LFU"; break;
+		case 0x25: res = "LFRU"; break;
+		case 0x26: res = "LFUDA"; break;
+		case 0x27: res = "ARC"; break;
+		case 0x28: res = "FIFO"; break;
+		case 0x29: res = "LIFO"; break;
+		case 0x2A: res = ""; break;
+		case 0x2B: res = ""; break;
+		case 0x2C: res = ""; break;
+		case 0x2D: res = ""; break;
+		case 0x2E: res = ""; break;
+		case 0x2F: res = "GREEDY"; break;
+		default: res = "NULL"; break;	
+	}
+
+	return res;
+}
+
+int Lookup_name(const char *name)
+{
+	for (int RM = 0x20; RM <= 0x2F; ++RM)
+		if (*Retrieve_name(RM) != '\0' && strcasecmp(name, Retrieve_name(RM)) == 0)
+			return RM;
+	return -1;
+}
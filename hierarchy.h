@@ -0,0 +1,42 @@
+#ifndef CACHE_HIERARCHY_H_
+#define CACHE_HIERARCHY_H_
+
+#include <stdint.h>
+#include "cache.h"
+
+/*
+** Helpers shared by sim, bench and sweep to turn the cache.cfg fields
+** (size in KB, associativity, block size, write mode) into a CacheConfig
+** plus the level's latency.
+*/
+
+// Latency of a level of size_kb, by size class
+StorageLatency Default_latency(int size_kb);
+// Prefetch buffer entries of a level of size_kb, by size class
+int Default_pf_buf_num(int size_kb);
+
+int ilog2(int x);
+// The level holds no whole number of sets, or set_num is not a power of
+// two where index_hash needs one (every index but CACHE_IDX_PRIME)
+bool Bad_geometry(int size_kb, int associativity, int block_size,
+	int index_hash = CACHE_IDX_MODULO);
+
+// Fill config for level (1-based) from the cache.cfg fields, no bypass
+void Make_config(CacheConfig &config, int level, int size_kb, int associativity,
+	int block_size, int write_through);
+
+// Levels in BYPASS_SET bypass regions whose miss rate passes 0.8
+#define BYPASS_SET	0x4
+#define BYPASS_SHIFTBIT	32
+#define BYPASS_THRESHOLD	0.8
+void Default_bypass(CacheConfig &config);
+
+// Stop with an error when the state of `cache` (level, 1-based) could not
+// be allocated
+void Check_allocated(Cache *cache, int level);
+
+const char * Retrieve_name(int replace_method);
+// Replace method by name, -1 if unknown
+int Lookup_name(const char *name);
+
+#endif //CACHE_HIERARCHY_H_
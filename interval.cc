@@ -0,0 +1,137 @@
+#include <string.h>
+#include "interval.h"
+
+IntervalWriter::IntervalWriter()
+{
+	out_ = NULL;
+	format_ = INTERVAL_CSV;
+	len_ = 0;
+	level_num_ = 0;
+	policy_ = "";
+	index_ = 0;
+}
+
+IntervalWriter::~IntervalWriter()
+{
+	Close();
+}
+
+bool IntervalWriter::Open(const char *path, int format)
+{
+	out_ = fopen(path, "w");
+	if (out_ == NULL)
+		return false;
+	format_ = format;
+	len_ = 0;
+	if (format_ == INTERVAL_CSV)
+		PutStr("policy,interval,level,access,miss,replace,fetch,prefetch,bypass,cycles\n");
+	return true;
+}
+
+void IntervalWriter::Close()
+{
+	if (out_ == NULL)
+		return;
+	Flush();
+	fclose(out_);
+	out_ = NULL;
+}
+
+void IntervalWriter::Flush()
+{
+	if (len_ > 0)
+		fwrite(buf_, 1, len_, out_);
+	len_ = 0;
+}
+
+void IntervalWriter::Reserve(size_t bytes)
+{
+	if (len_ + bytes > INTERVAL_BUF)
+		Flush();
+}
+
+void IntervalWriter::PutStr(const char *s)
+{
+	size_t n = strlen(s);
+
+	Reserve(n);
+	memcpy(buf_ + len_, s, n);
+	len_ += n;
+}
+
+void IntervalWriter::PutU64(uint64_t x)
+{
+	char tmp[20];
+	int n = 0;
+
+	Reserve(20);
+	do {
+		tmp[n++] = '0' + x % 10;
+		x /= 10;
+	} while (x);
+	while (n)
+		buf_[len_++] = tmp[--n];
+}
+
+void IntervalWriter::Begin(const char *policy, Storage **levels, int level_num)
+{
+	if (level_num > INTERVAL_LEVELS)
+		level_num = INTERVAL_LEVELS;
+	policy_ = policy;
+	level_num_ = level_num;
+	index_ = 0;
+	for (int i = 0; i < level_num_; ++i) {
+		levels_[i] = levels[i];
+		levels_[i] -> GetStats(last_[i]);
+	}
+}
+
+void IntervalWriter::Sample()
+{
+	static const char *csv_keys[] = { ",", ",", ",", ",", ",", ",", ",", "\n" };
+	static const char *json_keys[] = { ",\"access\":", ",\"miss\":", ",\"replace\":",
+		",\"fetch\":", ",\"prefetch\":", ",\"bypass\":", ",\"cycles\":", "}\n" };
+	const char **keys = format_ == INTERVAL_CSV ? csv_keys : json_keys;
+
+	if (out_ == NULL)
+		return;
+	for (int i = 0; i < level_num_; ++i) {
+		StorageStats now;
+		levels_[i] -> GetStats(now);
+
+		uint64_t delta[7] = {
+			now.access_counter - last_[i].access_counter,
+			now.miss_num - last_[i].miss_num,
+			now.replace_num - last_[i].replace_num,
+			now.fetch_num - last_[i].fetch_num,
+			now.prefetch_num - last_[i].prefetch_num,
+			now.bypass_num - last_[i].bypass_num,
+			now.access_cycle - last_[i].access_cycle
+		};
+		last_[i] = now;
+
+		if (format_ == INTERVAL_CSV) {
+			PutStr(policy_);
+			PutStr(",");
+			PutU64(index_);
+			PutStr(",");
+		}
+		else {
+			PutStr("{\"policy\":\"");
+			PutStr(policy_);
+			PutStr("\",\"interval\":");
+			PutU64(index_);
+			PutStr(",\"level\":");
+		}
+		if (i == level_num_ - 1)
+			PutStr(format_ == INTERVAL_CSV ? "mem" : "\"mem\"");
+		else
+			PutU64(i + 1);
+		for (int k = 0; k < 7; ++k) {
+			PutStr(keys[k]);
+			PutU64(delta[k]);
+		}
+		PutStr(keys[7]);
+	}
+	++index_;
+}
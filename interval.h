@@ -0,0 +1,51 @@
+#ifndef CACHE_INTERVAL_H_
+#define CACHE_INTERVAL_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "storage.h"
+
+#define INTERVAL_CSV	0x0
+#define INTERVAL_JSON	0x1 // JSON Lines
+
+#define INTERVAL_LEVELS	11
+#define INTERVAL_BUF	(1 << 16)
+
+/*
+** Per-interval stats records: every Sample() emits one record per level
+** holding the stats deltas since the previous sample. Records are
+** formatted into a fixed buffer and written out when it fills.
+*/
+class IntervalWriter {
+private:
+	void PutStr(const char *s);
+	void PutU64(uint64_t x);
+	void Reserve(size_t bytes);
+
+	FILE *out_;
+	int format_;
+	char buf_[INTERVAL_BUF];
+	size_t len_;
+
+	// Levels being sampled, the last one is main memory
+	Storage *levels_[INTERVAL_LEVELS];
+	StorageStats last_[INTERVAL_LEVELS];
+	int level_num_;
+	const char *policy_;
+	uint64_t index_;
+	
+	DISALLOW_COPY_AND_ASSIGN(IntervalWriter);
+
+public:
+	IntervalWriter();
+	~IntervalWriter();
+
+	bool Open(const char *path, int format);
+	// Start a run: levels[0..level_num-2] are caches, levels[level_num-1] is memory
+	void Begin(const char *policy, Storage **levels, int level_num);
+	void Sample();
+	void Flush();
+	void Close();
+};
+
+#endif //CACHE_INTERVAL_H_
@@ -1,114 +1,246 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
 #include <assert.h>
 #include <algorithm>
 #include "cache.h"
 #include "memory.h"
+#include "trace.h"
+#include "shm.h"
+#include "interval.h"
+#include "profile.h"
+#include "sample.h"
+#include "hierarchy.h"
+#include "tlb.h"
+#include "mix.h"
 
 #define EXE_CNT 100
-#define BYPASS_SET 0x4
+#define TRACE_MAX 1000010
 
-FILE *ftrace;
 int trace_tot;
-std::pair<uint64_t, char> trace_request[1000010];
+TraceRecord trace_request[TRACE_MAX];
+
+// Trace files, more than one is a multi-programmed mix (-M, -R, -Q)
+char **trace_files;
+int trace_num;
+int trace_streamed; // first pass decoded the traces into trace_request
+int mix_mode = MIX_RR;
+int mix_weight[MIX_STREAMS];
+int way_quota[MIX_STREAMS];
+uint64_t stream_cycle[MIX_STREAMS];
 
 int level;
 CacheConfig config[10];
 StorageLatency latency_cycles[10];
 
+Cache *cache_lists[10];
+Memory *Main_memory;
+
+// Interval stats
+uint64_t interval_len; // 0: off
+uint64_t interval_cnt;
+const char *interval_path;
+int interval_format;
+IntervalWriter interval_writer;
+int interval_on; // measuring, not warming up
+
+// Inclusion of every level below L1 (-H) and victim cache entries per level (-v)
+int inclusion = CACHE_NINE;
+int victim_num[10];
+// Set index function per level (-X)
+int index_hash[10];
+// Reuse predictor table bits per level (-P), bypass predicted-dead fills (-D)
+int ship_bits[10];
+int ship_bypass;
+// Write buffer entries per level (-B) and drain timer in accesses (-T)
+int wbuf_num[10];
+int wbuf_timeout = WBUF_TIMEOUT;
+
+// Set sampling of the last level, off unless -L is given
+int set_sample_shift;
+int set_sample_verify;
+
+// Sampled simulation, off unless -S is given
+Sampler sampler;
+
+// Address translation, off unless -t is given
+Tlb tlb;
+
+// Heat map (CACHE_HEATMAP builds)
+int heat_shiftbit = 20;
+FILE *heat_csv;
+
 int method_cnt;
 std::pair<uint64_t, int> acctot[110];
 std::pair<double, int> MR[10][110];
 std::pair<double, int> accAMAT[110];
 
-StorageLatency get_latency(int size)
+// Translate an access and issue it page by page
+void Issue_translated(const TraceRecord &rec, int read, int detailed, int replace_method)
 {
-	switch(size)
-	{
-		case 32: return StorageLatency(0, 3);
-		case 256: return StorageLatency(6, 4);
+	uint64_t vaddr = rec.addr;
+	uint64_t end = rec.addr + (rec.size > 1 ? rec.size : 1);
+
+	// walks are charged to the access's PC
+	cache_lists[1] -> SetContext(rec.pc, rec.tid);
+	while (vaddr < end) {
+		uint64_t page_end;
+		uint64_t paddr = tlb.Translate(vaddr, page_end, replace_method, detailed);
+		// frames are physical, the stream tag stays for per-stream stats
+		paddr |= vaddr & ~((1ULL << MIX_TAG_BIT) - 1);
+		uint64_t len = std::min(end, page_end) - vaddr;
+
+		if (detailed)
+			cache_lists[1] -> Access(paddr, len, read, replace_method, rec.pc, rec.tid);
+		else
+			cache_lists[1] -> FastAccess(paddr, len, read, replace_method);
+		vaddr += len;
 	}
-	return StorageLatency(-1, -1);
 }
 
-int get_pf_buf_num(int size)
+// Cycles of every level and memory so far
+inline uint64_t Hierarchy_cycles()
 {
-	switch(size)
-	{
-		case 32: return 64;
-		case 256: return 1024;
+	uint64_t cycles = Main_memory -> Cycles();
+	for (int i = 1; i <= level; ++i)
+		cycles += cache_lists[i] -> Cycles();
+	return cycles;
+}
+
+// Feed one trace access to the hierarchy
+inline void Issue(const TraceRecord &rec, int replace_method)
+{
+	PROFILE_SCOPE(0, PROF_HANDLE);
+	int read = rec.type == 'r';
+	int detailed = !sampler.Enabled() || sampler.Detailed();
+	uint64_t start = trace_num > 1 ? Hierarchy_cycles() : 0;
+
+	if (tlb.Enabled())
+		Issue_translated(rec, read, detailed, replace_method);
+	else if (detailed)
+		cache_lists[1] -> Access(rec.addr, rec.size, read, replace_method, rec.pc, rec.tid);
+	else
+		cache_lists[1] -> FastAccess(rec.addr, rec.size, read, replace_method);
+	if (trace_num > 1)
+		stream_cycle[(rec.addr >> MIX_TAG_BIT) & (MIX_STREAMS - 1)] += Hierarchy_cycles() - start;
+
+	if (sampler.Enabled()) {
+		if (detailed)
+			sampler.Advance();
+		return;
+	}
+	if (interval_on && ++interval_cnt == interval_len) {
+		interval_cnt = 0;
+		interval_writer.Sample();
 	}
-	return -1;
 }
 
-int ilog2(int x)
+// Start interval sampling from the current stats
+void Begin_intervals(int replace_method)
+{
+	Storage *levels[INTERVAL_LEVELS];
+
+	if (interval_len == 0)
+		return;
+	for (int i = 1; i <= level; ++i)
+		levels[i-1] = cache_lists[i];
+	levels[level] = Main_memory;
+	interval_writer.Begin(Retrieve_name(replace_method), levels, level + 1);
+	interval_cnt = 0;
+	interval_on = 1;
+}
+
+// Flush the last partial interval
+void End_intervals()
 {
-	int res = 0;
-	while(x >>= 1)
-		++res;
-	return res;
+	if (interval_on && interval_cnt > 0)
+		interval_writer.Sample();
+	interval_on = 0;
 }
 
-const char * Retrieve_name(int replace_method)
+// First pass over the traces: simulate records as the reader threads
+// decode them, in mix order when there are several, keeping a copy for
+// the remaining passes
+void Stream_trace(int replace_method)
 {
-	const char *res = NULL;
-	switch (replace_method)
-	{
-		case 0x20: res = "LRU"; break;
-		case 0x21: res = "MRU"; break;
-		case 0x22: res = "RR"; break;
-		case 0x23: res = "SLRU"; break;
-		case 0x24: res = "LFU"; break;
-		case 0x25: res = "LFRU"; break;
-		case 0x26: res = "LFUDA"; break;
-		case 0x27: res = "ARC"; break;
-		case 0x28: res = "FIFO"; break;
-		case 0x29: res = "LIFO"; break;
-		case 0x2A: res = ""; break;
-		case 0x2B: res = ""; break;
-		case 0x2C: res = ""; break;
-		case 0x2D: res = ""; break;
-		case 0x2E: res = ""; break;
-		case 0x2F: res = "GREEDY"; break;
-		default: res = "NULL"; break;	
+	TraceMixer mixer;
+	TraceRecord rec;
+	int stream, failed;
+
+	if ((failed = mixer.Open(trace_files, trace_num, mix_mode, mix_weight)) >= 0) {
+		printf("Cannot open trace file %s\n", trace_files[failed]);
+		throw;
+	}
+	if ((failed = mixer.TimeMismatch()) >= 0) {
+		printf("-M time needs timestamps in all traces or none, %s differs from %s\n",
+			trace_files[failed], trace_files[0]);
+		throw;
 	}
 
-	return res;
+	trace_tot = 0;
+	while (mixer.Next(rec, stream)) {
+		if (trace_tot < TRACE_MAX)
+			trace_request[trace_tot++] = rec;
+		Issue(rec, replace_method);
+	}
+	if ((failed = mixer.Failed()) >= 0) {
+		printf("Cannot read trace file %s: %s\n", trace_files[failed], mixer.Error());
+		throw;
+	}
+	mixer.Close();
+
+	if (trace_tot >= TRACE_MAX)
+		printf("Trace longer than %d requests, replaying the first %d\n", TRACE_MAX, TRACE_MAX);
+	printf("trace_tot = %d\n", trace_tot);
 }
 
-void Try_differ_RM(const char *tracefile, int replace_method)
-{
-	Cache *cache_lists[10];
-	Memory *Main_memory;
+void Report(int replace_method);
+void Report_sampled(int replace_method);
 
-	ftrace = fopen(tracefile, "r");
+// Built once, Reset() between replace methods
+void Build_hierarchy()
+{
 	Main_memory = new Memory;
 	cache_lists[level] = new Cache(config[level], Main_memory, Main_memory, latency_cycles[level]);
-	for (int i = level - 1; i >= 1; i--)
+	Check_allocated(cache_lists[level], level);
+	for (int i = level - 1; i >= 1; i--) {
 		cache_lists[i] = new Cache(config[i], cache_lists[i+1], Main_memory, latency_cycles[i]);
-	
-	trace_tot = 0;
-	while (true) {
-		char t;
-		uint64_t addr;
-		
-		if (fscanf(ftrace, "%c%lx\n", &t, &addr) == EOF)
-			break;
-		trace_request[trace_tot++] = std::pair<uint64_t, char> (addr, t);
+		Check_allocated(cache_lists[i], i);
 	}
-	printf("trace_tot = %d\n", trace_tot);
 
-	printf("Executing...\n");
-	printf("\033[0;32;32m" "Using replace policy: %s" "\033[m" "\n", Retrieve_name(replace_method));
+	Storage *levels[TLB_LEVELS];
+	for (int i = 1; i <= level; ++i)
+		levels[i-1] = cache_lists[i];
+	levels[level] = Main_memory;
+	tlb.Attach(levels, level + 1);
+}
+
+void Destroy_hierarchy()
+{
+	for (int i = 1; i <= level; i++)
+		delete cache_lists[i];
+	delete Main_memory;
+}
+
+// Reset, warm up and measure one replace method
+void Simulate(int replace_method)
+{
+	Main_memory -> Reset();
+	for (int i = 1; i <= level; i++)
+		cache_lists[i] -> Reset();
+	tlb.Reset();
+
 	// warm up
 	for (int i = 1; i <= EXE_CNT; ++i) {
-		for (int j = 0; j < trace_tot; ++j) {
-			char t; 
-			uint64_t addr;
-
-			t = trace_request[j].second;
-			addr = trace_request[j].first; 
-			cache_lists[1] -> HandleRequest(addr, t == 'r', replace_method);
+		if (!trace_streamed) { // not decoded yet
+			Stream_trace(replace_method);
+			trace_streamed = 1;
+			continue;
 		}
+		for (int j = 0; j < trace_tot; ++j)
+			Issue(trace_request[j], replace_method);
 	}
 	
 	// clear stats
@@ -117,26 +249,167 @@ void Try_differ_RM(const char *tracefile, int replace_method)
 	for (int i = 1; i <= level; ++i) {
 		cache_lists[i] -> SetStats(zerostats);
 		cache_lists[i] -> BypassClear();
+		cache_lists[i] -> HeatClear();
+		cache_lists[i] -> PcClear();
+		cache_lists[i] -> StreamClear();
 	}
+	tlb.Clear();
+	memset(stream_cycle, 0, sizeof(stream_cycle));
 	
 	// re-execute
+	if (sampler.Enabled()) {
+		Storage *levels[SAMPLE_LEVELS];
+		for (int i = 1; i <= level; ++i)
+			levels[i-1] = cache_lists[i];
+		sampler.Begin(levels, latency_cycles + 1, level, Main_memory);
+	}
+	Begin_intervals(replace_method);
 	for (int i = 1; i <= EXE_CNT / 10; ++i) {
-	for (int j = 0; j < trace_tot; ++j) {
-		char t; 
-		uint64_t addr;
-
-		t = trace_request[j].second;
-		addr = trace_request[j].first; 
-		cache_lists[1] -> HandleRequest(addr, t == 'r', replace_method);
-		
+	for (int j = 0; j < trace_tot; ++j)
+		Issue(trace_request[j], replace_method);
 	}
+	cache_lists[1] -> Flush(replace_method);
+	End_intervals();
+	if (sampler.Enabled())
+		sampler.End();
+
+	// set sampling: scale the last level, and the memory traffic it sent,
+	// to all sets; writes from above that went past it were all simulated
+	if (set_sample_shift > 0) {
+		double scale = cache_lists[level] -> ExtrapolateStats();
+		StorageStats mem;
+		Main_memory -> GetStats(mem);
+		uint64_t access = (uint64_t) ((mem.access_counter - mem.direct_num) * scale + 0.5) + mem.direct_num;
+		if (mem.access_counter > 0)
+			mem.access_cycle = (uint64_t) ((double) mem.access_cycle * access / mem.access_counter + 0.5);
+		mem.access_counter = access;
+		Main_memory -> SetStats(mem);
 	}
+}
+
+double Relative_error(double est, double ref)
+{
+	if (ref == 0)
+		return est == 0 ? 0 : 100.0;
+	return 100.0 * (est - ref) / ref;
+}
+
+// Full run without set sampling, for -V. Runs before the sampled one, so
+// every level and memory report the sampled run afterwards
+void Reference_run(int replace_method, StorageStats &ref, StorageStats &ref_mem)
+{
+	int shift = set_sample_shift;
+
+	set_sample_shift = 0;
+	cache_lists[level] -> SetSetSampling(0);
+	Simulate(replace_method);
+	cache_lists[level] -> GetStats(ref);
+	Main_memory -> GetStats(ref_mem);
+	set_sample_shift = shift;
+	cache_lists[level] -> SetSetSampling(shift);
+}
+
+// Print how far the extrapolation of the last level and memory was off
+void Verify_set_sampling(const StorageStats &ref, const StorageStats &ref_mem)
+{
+	StorageStats est, est_mem;
+
+	cache_lists[level] -> GetStats(est);
+	Main_memory -> GetStats(est_mem);
+
+	double est_mr = est.access_counter ? (double) est.miss_num / est.access_counter : 0;
+	double ref_mr = ref.access_counter ? (double) ref.miss_num / ref.access_counter : 0;
+	printf("Set sampling error (Level %d, %d of %d sets) vs full run:\n",
+		level, cache_lists[level] -> SampledSets(), config[level].set_num);
+	printf("miss_rate:\t%3.6f%% vs %3.6f%%\t(%+.3f%%)\n", est_mr * 100.0, ref_mr * 100.0, Relative_error(est_mr, ref_mr));
+	printf("miss_num:\t%ld vs %ld\t(%+.3f%%)\n", est.miss_num, ref.miss_num, Relative_error(est.miss_num, ref.miss_num));
+	printf("replace_num:\t%ld vs %ld\t(%+.3f%%)\n", est.replace_num, ref.replace_num, Relative_error(est.replace_num, ref.replace_num));
+	printf("access_cycle:\t%ld vs %ld\t(%+.3f%%)\n", est.access_cycle, ref.access_cycle, Relative_error(est.access_cycle, ref.access_cycle));
+	printf("memory access:\t%ld vs %ld\t(%+.3f%%)\n", est_mem.access_counter, ref_mem.access_counter,
+		Relative_error(est_mem.access_counter, ref_mem.access_counter));
+}
+
+void Try_differ_RM(int replace_method)
+{
+	StorageStats ref, ref_mem;
+	int verify = set_sample_shift > 0 && set_sample_verify;
+
+	printf("Executing...\n");
+	printf("\033[0;32;32m" "Using replace policy: %s" "\033[m" "\n", Retrieve_name(replace_method));
+	if (verify)
+		Reference_run(replace_method, ref, ref_mem);
+	Simulate(replace_method);
+	if (verify)
+		Verify_set_sampling(ref, ref_mem);
 	
+	if (sampler.Enabled())
+		Report_sampled(replace_method);
+	else
+		Report(replace_method);
+}
+
+// Report for a sampled run: per-unit means with 95% confidence intervals
+void Report_sampled(int replace_method)
+{
+	double ci;
+
+	printf("Sampled units:\t%lu\n", sampler.Units());
+	for (int i = 1; i <= level; i++) {
+		double nwMR = sampler.MissRate(i - 1, ci);
+		printf("Level %d Cache info:\n", i);
+		printf("miss_rate:\t%3.6f%% +- %3.6f%%\n", nwMR * 100.0, ci * 100.0);
+		MR[i][method_cnt].first = nwMR * 100.0;
+		MR[i][method_cnt].second = replace_method;
+	}
+
+	uint64_t accesses = (uint64_t) trace_tot * (EXE_CNT / 10);
+	uint64_t tot = sampler.Cycles(accesses);
+	if (tlb.Enabled()) {
+		tlb.PrintInfo();
+		tot += tlb.Cycles(accesses);
+	}
+
+	printf("Total Cycles (extrapolated):\t%ld\n", tot);
+
+	double AMAT = sampler.AMAT(ci);
+	printf("AMAT:\t%.7f +- %.7f\n", AMAT, ci);
+	accAMAT[method_cnt].first = AMAT;
+	accAMAT[method_cnt].second = replace_method;
+
+	acctot[method_cnt].first = tot;
+	acctot[method_cnt].second = replace_method;
+
+	++method_cnt;
+	printf("\n");
+}
+
+// Cycles each stream of a mix spent in the hierarchy, per L1 access
+void Print_streams()
+{
+	StreamStat ss;
+
+	for (int s = 0; s < trace_num; ++s) {
+		cache_lists[1] -> GetStreamStats(s, ss);
+		printf("Stream %d (%s):\tcycles: %lu\tcycles/access: %.4f\n", s, trace_files[s],
+			stream_cycle[s], ss.access ? (double) stream_cycle[s] / ss.access : 0);
+	}
+}
+
+// Print the current stats and add them to the ranklists
+void Report(int replace_method)
+{
 	// print_info
 	uint64_t tot = 0;
 	for (int i = 1; i <= level; i++) {
 		printf("Level %d Cache info:\n", i);
 		tot += cache_lists[i] -> print_info();
+		cache_lists[i] -> PrintPcStats();
+		cache_lists[i] -> PrintStreamStats();
+#ifdef CACHE_HEATMAP
+		cache_lists[i] -> PrintHeatmap();
+		if (heat_csv != NULL)
+			cache_lists[i] -> DumpHeatmap(heat_csv, Retrieve_name(replace_method), i);
+#endif
 
 		StorageStats nwstats;
 		cache_lists[i] -> GetStats(nwstats);
@@ -147,6 +420,12 @@ void Try_differ_RM(const char *tracefile, int replace_method)
 	}
 	printf("Memory info\n");
 	tot += Main_memory -> print_info();
+	if (tlb.Enabled()) {
+		tlb.PrintInfo();
+		tot += tlb.Cycles();
+	}
+	if (trace_num > 1)
+		Print_streams();
 	printf("Total Cycles:\t%ld\n", tot);
 
 	double AMAT = 100;
@@ -163,12 +442,279 @@ void Try_differ_RM(const char *tracefile, int replace_method)
 	acctot[method_cnt].second = replace_method;
 
 	++method_cnt;
-	fclose(ftrace);
 	printf("\n");
 }
 
+// Simulate accesses straight out of a shared-memory ring until the
+// producer detaches
+void Run_live(const char *shm_name, int replace_method)
+{
+	ShmRing *ring = ShmRing::Create(shm_name, SHM_RING_CAP);
+	const TraceRecord *recs;
+	uint64_t consumed, dropped, stalls;
+
+	if (ring == NULL) {
+		printf("Cannot create the trace ring %s\n", shm_name);
+		throw;
+	}
+
+	Main_memory -> Reset();
+	for (int i = 1; i <= level; i++)
+		cache_lists[i] -> Reset();
+	tlb.Reset();
+
+	Begin_intervals(replace_method);
+	printf("Waiting for accesses on %s...\n", shm_name);
+	printf("\033[0;32;32m" "Using replace policy: %s" "\033[m" "\n", Retrieve_name(replace_method));
+	while (true) {
+		size_t num = ring -> Peek(recs);
+		if (num == 0) {
+			PROFILE_SCOPE(0, PROF_TRACE);
+			if (ring -> Finished())
+				break;
+			usleep(100);
+			continue;
+		}
+		for (size_t j = 0; j < num; ++j)
+			Issue(recs[j], replace_method);
+		ring -> Consume(num);
+	}
+	cache_lists[1] -> Flush(replace_method);
+	End_intervals();
+
+	ring -> GetCounters(consumed, dropped, stalls);
+	printf("consumed:\t%ld\n", consumed);
+	printf("dropped:\t%ld\n", dropped);
+	printf("producer_stalls:\t%ld\n", stalls);
+	delete ring;
+
+	Report(replace_method);
+}
+
+int Lookup_RM(const char *name)
+{
+	int RM = Lookup_name(name);
+	if (RM != -1)
+		return RM;
+	printf("No such Replace Method: %s\n", name);
+	throw;
+}
+
+void usage(const char *prog)
+{
+	printf("Usage: %s [options] TRACEFILE...|shm:NAME [REPLACE_METHOD] < cache.cfg\n", prog);
+	printf("\t-i N\temit per-level stats every N accesses while measuring\n");
+	printf("\t-f csv|json\tinterval record format (default csv)\n");
+	printf("\t-o FILE\tinterval output (default intervals.csv|intervals.jsonl)\n");
+	printf("\t-S K\tsampled simulation, measure one unit every K units\n");
+	printf("\t-U N\tsampling unit length in accesses (default 1000)\n");
+	printf("\t-W N\tdetailed warming before each unit (default 2000)\n");
+	printf("\t-H nine|inclusive|exclusive\tinclusion of each level below L1 (default nine)\n");
+	printf("\t-v N,...\tvictim cache entries for L1, L2, ... (default none)\n");
+	printf("\t-X modulo|xor|prime|skew,...\tset index function for L1, L2, ... (default modulo)\n");
+	printf("\t-P BITS,...\treuse predictor with 2^BITS counters for L1, L2, ... (default none)\n");
+	printf("\t-D\twith -P, predicted-dead fills bypass instead of inserting at low priority\n");
+	printf("\t-B N,...\tcoalescing write buffer entries for L1, L2, ... (default none)\n");
+	printf("\t-T N\twith -B, drain a buffered block N accesses after it was filled, 0 only when full (default %d)\n", WBUF_TIMEOUT);
+	printf("\t-t identity|random|2m|1g\ttranslate through L1/L2 TLBs with this page mapper (default off)\n");
+	printf("\t-M rr|rate|time\tinterleaving of several trace files (default rr)\n");
+	printf("\t-R W,...\twith -M rate, accesses of each trace per round (default 1)\n");
+	printf("\t-Q WAYS,...\tpartition the last level's ways between the traces\n");
+	printf("\t-L SHIFT\tsimulate 1/2^SHIFT of the last level's sets and extrapolate\n");
+	printf("\t-V\twith -L, also run all sets and report the extrapolation error\n");
+#ifdef CACHE_HEATMAP
+	printf("\t-r SHIFT\theat map region = tag >> SHIFT (default 20)\n");
+	printf("\t-m FILE\theat map CSV output (default heatmap.csv)\n");
+#endif
+}
+
+#ifdef CACHE_HEATMAP
+#define HEAT_OPTS	"r:m:"
+#else
+#define HEAT_OPTS	""
+#endif
+
 int main(int argc, char* argv[]) 
 {
+	int opt;
+#ifdef CACHE_HEATMAP
+	const char *heat_path = "heatmap.csv";
+#endif
+	uint64_t sample_k = 0, sample_unit = 1000, sample_warm = 2000;
+
+	interval_format = INTERVAL_CSV;
+	while ((opt = getopt(argc, argv, "i:f:o:" HEAT_OPTS "S:U:W:L:VH:v:X:P:DB:T:t:M:R:Q:")) != -1) {
+		switch (opt) {
+			case 'i': interval_len = strtoull(optarg, NULL, 0); break;
+			case 'f': interval_format = strcmp(optarg, "json") == 0 ? INTERVAL_JSON : INTERVAL_CSV; break;
+			case 'o': interval_path = optarg; break;
+#ifdef CACHE_HEATMAP
+			case 'r': heat_shiftbit = atoi(optarg); break;
+			case 'm': heat_path = optarg; break;
+#endif
+			case 'S': sample_k = strtoull(optarg, NULL, 0); break;
+			case 'U': sample_unit = strtoull(optarg, NULL, 0); break;
+			case 'W': sample_warm = strtoull(optarg, NULL, 0); break;
+			case 'L': set_sample_shift = atoi(optarg); break;
+			case 'V': set_sample_verify = 1; break;
+			case 'H':
+				if (strcmp(optarg, "inclusive") == 0)
+					inclusion = CACHE_INCLUSIVE;
+				else if (strcmp(optarg, "exclusive") == 0)
+					inclusion = CACHE_EXCLUSIVE;
+				else if (strcmp(optarg, "nine") != 0) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'X': {
+				static const char *hash_name[] = { "modulo", "xor", "prime", "skew" };
+				char *arg = strtok(optarg, ",");
+				for (int i = 1; i < 10 && arg != NULL; ++i, arg = strtok(NULL, ",")) {
+					index_hash[i] = -1;
+					for (int h = CACHE_IDX_MODULO; h <= CACHE_IDX_SKEW; ++h)
+						if (strcmp(arg, hash_name[h]) == 0)
+							index_hash[i] = h;
+					if (index_hash[i] == -1) {
+						usage(argv[0]);
+						return 1;
+					}
+				}
+				break;
+			}
+			case 'P': {
+				char *arg = optarg;
+				for (int i = 1; i < 10 && *arg != '\0'; ++i) {
+					ship_bits[i] = strtol(arg, &arg, 0);
+					if (ship_bits[i] < 0 || ship_bits[i] > 24) {
+						printf("Predictor bits must be 0-24\n");
+						return 1;
+					}
+					if (*arg == ',')
+						++arg;
+				}
+				break;
+			}
+			case 'D': ship_bypass = 1; break;
+			case 'v': {
+				char *arg = optarg;
+				for (int i = 1; i < 10 && *arg != '\0'; ++i) {
+					victim_num[i] = strtol(arg, &arg, 0);
+					if (*arg == ',')
+						++arg;
+				}
+				break;
+			}
+			case 'B': {
+				char *arg = optarg;
+				for (int i = 1; i < 10 && *arg != '\0'; ++i) {
+					wbuf_num[i] = strtol(arg, &arg, 0);
+					if (*arg == ',')
+						++arg;
+				}
+				break;
+			}
+			case 'T': wbuf_timeout = atoi(optarg); break;
+			case 'M':
+				if (strcmp(optarg, "rr") == 0)
+					mix_mode = MIX_RR;
+				else if (strcmp(optarg, "rate") == 0)
+					mix_mode = MIX_RATE;
+				else if (strcmp(optarg, "time") == 0)
+					mix_mode = MIX_TIME;
+				else {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'R': {
+				char *arg = optarg;
+				for (int i = 0; i < MIX_STREAMS && *arg != '\0'; ++i) {
+					mix_weight[i] = strtol(arg, &arg, 0);
+					if (*arg == ',')
+						++arg;
+				}
+				break;
+			}
+			case 'Q': {
+				char *arg = optarg;
+				for (int i = 0; i < MIX_STREAMS && *arg != '\0'; ++i) {
+					way_quota[i] = strtol(arg, &arg, 0);
+					if (*arg == ',')
+						++arg;
+				}
+				break;
+			}
+			case 't': {
+				static const char *map_name[] = { "off", "identity", "random", "2m", "1g" };
+				int map = -1;
+				for (int m = TLB_MAP_OFF; m <= TLB_MAP_1G; ++m)
+					if (strcmp(optarg, map_name[m]) == 0)
+						map = m;
+				if (!tlb.Configure(map)) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			}
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	trace_files = argv + optind;
+	trace_num = strncmp(argv[optind], "shm:", 4) == 0 ? 1 : argc - optind;
+	if (trace_num > MIX_STREAMS) {
+		printf("At most %d traces can be mixed\n", MIX_STREAMS);
+		return 1;
+	}
+	if (trace_num == 1 && way_quota[0] > 0) {
+		printf("Way quotas need at least two traces\n");
+		return 1;
+	}
+	// per-stream counters are not scaled by either kind of sampling
+	if (trace_num > 1 && (sample_k > 0 || set_sample_shift > 0)) {
+		printf("Several traces cannot be mixed with -S or -L\n");
+		return 1;
+	}
+	// a live run simulates every access and reports it as is
+	if ((sample_k > 0 || set_sample_shift > 0) && strncmp(argv[optind], "shm:", 4) == 0) {
+		printf("A live trace (shm:) cannot be sampled with -S or -L\n");
+		return 1;
+	}
+	if (sample_k > 0 && !sampler.Configure(sample_unit, sample_warm, sample_k)) {
+		printf("Sampling period must cover warming and unit: K * U >= U + W\n");
+		return 1;
+	}
+	// intervals count every access, the sampler fast-forwards most of them
+	if (sample_k > 0 && interval_len > 0) {
+		printf("Interval output (-i) cannot be combined with -S\n");
+		return 1;
+	}
+	if (set_sample_shift < 0 || set_sample_shift > 16) {
+		printf("Set sampling shift must be 0-16\n");
+		return 1;
+	}
+	if (interval_len > 0) {
+		if (interval_path == NULL)
+			interval_path = interval_format == INTERVAL_CSV ? "intervals.csv" : "intervals.jsonl";
+		if (!interval_writer.Open(interval_path, interval_format)) {
+			printf("Cannot open %s\n", interval_path);
+			return 1;
+		}
+	}
+
+#ifdef CACHE_HEATMAP
+	heat_csv = fopen(heat_path, "w");
+	if (heat_csv == NULL) {
+		printf("Cannot open %s\n", heat_path);
+		return 1;
+	}
+	fprintf(heat_csv, "policy,level,kind,index,access,miss,evict,dirty_evict\n");
+#endif
+
 	printf("Cache Simulator started.\n");
 	
 	printf("Set Cache level: ");
@@ -177,34 +723,64 @@ int main(int argc, char* argv[])
 	
 	printf("Set Cache info for %d levels:\n", level);
 	for (int i = 1; i <= level; ++i) {
-		int cache_size;
+		int cache_size, associativity, block_size, write_through;
 		printf("Size(KB) | Associativity | block_size | write_mode\n");
 		
-		scanf("%d%d%d%d", &cache_size, &config[i].associativity, &config[i].block_size, &config[i].write_through);
-		latency_cycles[i] = get_latency(cache_size);
-		// prefetch config
-		config[i].pf_buf_num = get_pf_buf_num(cache_size);
-		config[i].size = (1LL << 10) * cache_size;
-		config[i].set_num = config[i].size / (config[i].associativity * config[i].block_size);
-		config[i].write_allocate = 1 - config[i].write_through;
-		config[i].block_bit = ilog2(config[i].block_size);
-		config[i].set_bit = ilog2(config[i].set_num);
-		
-		// bypass config
-		if ((BYPASS_SET >> i)&1) {
-			config[i].bypass_shiftbit = 32;
-			config[i].bypass_threshold = 0.8;
+		scanf("%d%d%d%d", &cache_size, &associativity, &block_size, &write_through);
+		if (Bad_geometry(cache_size, associativity, block_size, index_hash[i])) {
+			printf("Level %d: %dKB / %d-way / %dB blocks is not a power-of-2 set count"
+				" (any count needs -X prime)\n", i, cache_size, associativity, block_size);
+			return 1;
 		}
-		else {
-			config[i].bypass_shiftbit = -1;
+		Make_config(config[i], i, cache_size, associativity, block_size, write_through);
+		latency_cycles[i] = Default_latency(cache_size);
+		config[i].heat_shiftbit = heat_shiftbit;
+		config[i].set_sample_shift = i == level ? set_sample_shift : 0;
+		config[i].inclusion = i > 1 ? inclusion : CACHE_NINE;
+		config[i].victim_num = victim_num[i] > 0 ? victim_num[i] : 0;
+		if (config[i].victim_num > 0 && sampler.Enabled()) {
+			printf("Victim caches are not modelled while fast-forwarding, drop -v or -S\n");
+			return 1;
 		}
-
+		config[i].index_hash = index_hash[i];
+		config[i].ship_bits = ship_bits[i];
+		config[i].ship_bypass = ship_bypass;
+		config[i].wbuf_num = wbuf_num[i] > 0 ? wbuf_num[i] : 0;
+		config[i].wbuf_timeout = wbuf_timeout > 0 ? wbuf_timeout : 0;
+		config[i].stream_num = trace_num > 1 ? trace_num : 0;
+		if (i == level && way_quota[0] > 0) { // way partitioning of the last level
+			int way = 0;
+			for (int s = 0; s < trace_num; ++s) {
+				if (way_quota[s] <= 0 || way + way_quota[s] > associativity || associativity > 32
+				 || config[i].index_hash == CACHE_IDX_SKEW) {
+					printf("Way quotas need one entry per trace, at most %d ways in all, and no skew index\n",
+						associativity);
+					return 1;
+				}
+				config[i].way_mask[s] = (uint32_t) (((1ULL << way_quota[s]) - 1) << way);
+				way += way_quota[s];
+			}
+		}
+		
+		// bypass config
+		Default_bypass(config[i]);
 	}
 	
 	// replace method config
+	Build_hierarchy();
+	Profile_begin();
 	method_cnt = 0;
-	for (int RM = 0x20; RM <= 0x29; ++RM)
-		Try_differ_RM(argv[1], RM);
+	if (strncmp(argv[optind], "shm:", 4) == 0) { // live trace, one policy
+		Run_live(argv[optind] + 4, optind + 1 < argc ? Lookup_RM(argv[optind + 1]) : CACHE_RM_LRU);
+	}
+	else {
+		for (int RM = 0x20; RM <= 0x29; ++RM)
+			Try_differ_RM(RM);
+	}
+	Destroy_hierarchy();
+	interval_writer.Close();
+	if (heat_csv != NULL)
+		fclose(heat_csv);
 
 	for (int i = 1; i <= level; ++i) {
 		sort(MR[i], MR[i] + method_cnt);
@@ -231,5 +807,7 @@ int main(int argc, char* argv[])
 		printf("| With replace method:\t%6s\n", Retrieve_name(accAMAT[i].second));
 	}
 	
+	Profile_print();
+
 	return 0;
 }
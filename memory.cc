@@ -1,6 +1,8 @@
 #include "memory.h"
+#include "profile.h"
 
 void Memory::HandleRequest(uint64_t addr, int read, int replace_method) {
+	PROFILE_SCOPE(PROF_MEM, PROF_HANDLE);
 	++stats_.access_counter;
 //	if (!prefetch)
 	stats_.access_cycle += latency_.hit_latency + latency_.bus_latency;
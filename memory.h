@@ -21,6 +21,13 @@ public:
 
 	// Main access process
 	void HandleRequest(uint64_t addr, int read, int replace_method);
+	// From a level above the last one, past it
+	void HandleDirect(uint64_t addr, int read, int replace_method)
+	{
+		++stats_.direct_num;
+		HandleRequest(addr, read, replace_method);
+	}
+	void FastForward(uint64_t addr, int read, int replace_method) {}
 };
 
 #endif //CACHE_MEMORY_H_ 
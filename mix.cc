@@ -0,0 +1,137 @@
+#include "mix.h"
+#include "profile.h"
+
+TraceMixer::TraceMixer()
+{
+	stream_ = NULL;
+	num_ = 0;
+	mode_ = MIX_RR;
+	last_ = -1;
+	failed_ = -1;
+	timed_ = 0;
+	mismatch_ = -1;
+}
+
+TraceMixer::~TraceMixer()
+{
+	Close();
+}
+
+int TraceMixer::Open(char **paths, int num, int mode, const int *weight)
+{
+	Close();
+	stream_ = new MixStream[num];
+	num_ = num;
+	mode_ = mode;
+	last_ = -1;
+	failed_ = -1;
+	for (int s = 0; s < num; ++s) {
+		MixStream &m = stream_[s];
+		m.batch = NULL;
+		m.pos = 0;
+		m.index = 0;
+		m.done = 0;
+		m.stride = MIX_STRIDE / (weight != NULL && weight[s] > 0 ? weight[s] : 1);
+		m.pass = m.stride;
+		if (!m.reader.Open(paths[s]))
+			return s;
+	}
+
+	timed_ = -1;
+	mismatch_ = -1;
+	for (int s = 0; s < num && mode == MIX_TIME; ++s) {
+		const TraceRecord *rec = Peek(s);
+		if (rec == NULL)
+			continue;
+		int timed = rec -> time != 0;
+		if (timed_ == -1)
+			timed_ = timed;
+		else if (timed != timed_ && mismatch_ == -1)
+			mismatch_ = s;
+	}
+	timed_ = timed_ == 1;
+	return -1;
+}
+
+void TraceMixer::Close()
+{
+	if (stream_ == NULL)
+		return;
+	for (int s = 0; s < num_; ++s)
+		stream_[s].reader.Close();
+	delete [] stream_;
+	stream_ = NULL;
+	num_ = 0;
+}
+
+const TraceRecord *TraceMixer::Peek(int s)
+{
+	MixStream &m = stream_[s];
+
+	if (m.done)
+		return NULL;
+	while (m.batch == NULL || m.pos == m.batch->num) {
+		PROFILE_SCOPE(0, PROF_TRACE);
+		if (m.batch != NULL)
+			m.reader.Release();
+		m.pos = 0;
+		if ((m.batch = m.reader.Next()) == NULL) {
+			m.done = 1;
+			if (failed_ == -1 && m.reader.Error() != NULL)
+				failed_ = s;
+			return NULL;
+		}
+	}
+	return &m.batch->rec[m.pos];
+}
+
+// Live stream to take the next record from, -1 when all ended
+int TraceMixer::Pick()
+{
+	int pick = -1;
+
+	if (mode_ == MIX_RR) {
+		for (int i = 1; i <= num_; ++i) {
+			int s = (last_ + i) % num_;
+			if (Peek(s) != NULL) {
+				last_ = s;
+				return s;
+			}
+		}
+		return -1;
+	}
+
+	uint64_t best = 0;
+	for (int s = 0; s < num_; ++s) {
+		const TraceRecord *rec = Peek(s);
+		if (rec == NULL)
+			continue;
+		uint64_t key;
+		if (mode_ == MIX_RATE)
+			key = stream_[s].pass;
+		else
+			key = timed_ ? rec -> time : stream_[s].index;
+		if (pick == -1 || key < best) {
+			pick = s;
+			best = key;
+		}
+	}
+	return pick;
+}
+
+bool TraceMixer::Next(TraceRecord &rec, int &stream)
+{
+	int s = num_ == 1 ? 0 : Pick();
+	const TraceRecord *next = s >= 0 ? Peek(s) : NULL;
+
+	if (next == NULL || failed_ >= 0)
+		return false;
+	rec = *next;
+	++stream_[s].pos;
+	++stream_[s].index;
+	stream_[s].pass += stream_[s].stride;
+	if (num_ > 1)
+		rec.addr = (rec.addr & ((1ULL << MIX_TAG_BIT) - 1)) | (uint64_t) s << MIX_TAG_BIT;
+	stream = s;
+	return true;
+}
@@ -0,0 +1,66 @@
+#ifndef CACHE_MIX_H_
+#define CACHE_MIX_H_
+
+#include <stdint.h>
+#include "trace.h"
+#include "cache.h"
+
+// Interleaving of a multi-programmed mix
+#define MIX_RR	0x0 // one access per stream in turn
+#define MIX_RATE	0x1 // weight[s] accesses of stream s per round, spread out
+#define MIX_TIME	0x2 // smallest timestamp first, the record index if the traces have none
+#define MIX_STRIDE	(1 << 20) // stride scheduling for MIX_RATE: pass += MIX_STRIDE / weight
+
+/*
+** Reads several traces at once, each on its own TraceReader, and hands out
+** their records in mix order. With more than one trace, stream s gets the
+** address-space tag s in the bits from MIX_TAG_BIT up, so the streams never
+** share a block. A stream that reaches its end drops out of the mix.
+*/
+class TraceMixer {
+private:
+	typedef struct MixStream_ {
+		TraceReader reader;
+		const TraceBatch *batch;
+		int pos; // next record in batch
+		uint64_t index; // records handed out
+		uint64_t pass; // MIX_RATE
+		uint64_t stride;
+		int done; // reader returned the end of the trace
+	} MixStream;
+
+	// Current record of stream s, NULL once it ended
+	const TraceRecord *Peek(int s);
+	int Pick();
+
+	MixStream *stream_;
+	int num_;
+	int mode_;
+	int last_; // MIX_RR
+	int failed_; // stream whose trace could not be read, -1 if none
+	int timed_; // MIX_TIME: the traces carry timestamps
+	int mismatch_; // MIX_TIME: a trace timed unlike the first, -1 if none
+
+	DISALLOW_COPY_AND_ASSIGN(TraceMixer);
+
+public:
+	TraceMixer();
+	~TraceMixer();
+
+	// weight[s] >= 1 for MIX_RATE, may be NULL otherwise. Returns the index
+	// of a trace that cannot be read, -1 when all are open
+	int Open(char **paths, int num, int mode, const int *weight);
+	// MIX_TIME needs timestamps on every trace or on none, judged by the
+	// first record of each. After Open, a trace that differs, -1 if none
+	int TimeMismatch() { return mismatch_; }
+	// Next record in mix order with its stream, false when every stream
+	// ended or one could not be read
+	bool Next(TraceRecord &rec, int &stream);
+	// After Next() returned false: the stream whose trace failed to read
+	// and the reader's message, -1 if all ended cleanly
+	int Failed() { return failed_; }
+	const char *Error() { return failed_ >= 0 ? stream_[failed_].reader.Error() : NULL; }
+	void Close();
+};
+
+#endif //CACHE_MIX_H_
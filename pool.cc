@@ -0,0 +1,62 @@
+#include <thread>
+#include "pool.h"
+
+WorkPool::WorkPool(int threads)
+{
+	if (threads <= 0)
+		threads = std::thread::hardware_concurrency();
+	threads_ = threads > 0 ? threads : 1;
+	queue_ = new WorkQueue[threads_];
+}
+
+WorkPool::~WorkPool()
+{
+	delete[] queue_;
+}
+
+bool WorkPool::Pop(int self, int &job)
+{
+	std::lock_guard<std::mutex> guard(queue_[self].lock);
+	if (queue_[self].jobs.empty())
+		return false;
+	job = queue_[self].jobs.back();
+	queue_[self].jobs.pop_back();
+	return true;
+}
+
+bool WorkPool::Steal(int self, int &job)
+{
+	for (int i = 1; i < threads_; ++i) {
+		WorkQueue &victim = queue_[(self + i) % threads_];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.jobs.empty()) {
+			job = victim.jobs.front();
+			victim.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkPool::Work(int self)
+{
+	int job;
+
+	// nothing is pushed after Run() starts, so empty everywhere means done
+	while (Pop(self, job) || Steal(self, job))
+		run_(job);
+}
+
+void WorkPool::Run(const std::vector<int> &jobs, std::function<void(int)> job)
+{
+	std::vector<std::thread> workers;
+
+	run_ = job;
+	for (size_t i = 0; i < jobs.size(); ++i)
+		queue_[i % threads_].jobs.push_back(jobs[i]);
+	for (int i = 1; i < threads_; ++i)
+		workers.push_back(std::thread(&WorkPool::Work, this, i));
+	Work(0);
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+}
@@ -0,0 +1,43 @@
+#ifndef CACHE_POOL_H_
+#define CACHE_POOL_H_
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "storage.h"
+
+/*
+** Work-stealing pool for a fixed batch of jobs:
+**	jobs are dealt round-robin to per-worker deques, each worker takes
+**	from the back of its own deque and, once empty, steals from the front
+**	of the others. Workers exit when every deque is empty.
+*/
+class WorkPool {
+private:
+	typedef struct WorkQueue_ {
+		std::mutex lock;
+		std::deque<int> jobs;
+	} WorkQueue;
+
+	int threads_;
+	WorkQueue *queue_;
+	std::function<void(int)> run_;
+
+	bool Pop(int self, int &job);
+	bool Steal(int self, int &job);
+	void Work(int self);
+
+	DISALLOW_COPY_AND_ASSIGN(WorkPool);
+
+public:
+	// threads <= 0 uses every hardware thread
+	WorkPool(int threads);
+	~WorkPool();
+
+	int Threads() { return threads_; }
+	// Run job(i) for every i in jobs, return when all are done
+	void Run(const std::vector<int> &jobs, std::function<void(int)> job);
+};
+
+#endif //CACHE_POOL_H_
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <string.h>
+#include "profile.h"
+
+#ifdef CACHE_PROFILE
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+thread_local ProfStage prof_stage[PROF_LEVELS][PROF_STAGES];
+thread_local uint64_t prof_child;
+
+static const char *stage_name[PROF_STAGES] = {
+	"trace", "handle", "bypass", "prefetch", "replace_decision", "replace_algorithm"
+};
+
+#define PERF_COUNTERS 3
+static const uint64_t perf_config[PERF_COUNTERS] = {
+	PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+static const char *perf_name[PERF_COUNTERS] = { "cycles", "cache-misses", "branch-misses" };
+static int perf_fd[PERF_COUNTERS] = { -1, -1, -1 };
+
+void Profile_begin()
+{
+	for (int i = 0; i < PERF_COUNTERS; ++i) {
+		struct perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = perf_config[i];
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		perf_fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (perf_fd[i] >= 0) {
+			ioctl(perf_fd[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(perf_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+void Profile_print()
+{
+	uint64_t total = 0;
+
+	for (int lv = 0; lv < PROF_LEVELS; ++lv)
+		for (int st = 0; st < PROF_STAGES; ++st)
+			total += prof_stage[lv][st].self;
+	if (total == 0)
+		total = 1;
+
+	printf("Profile (rdtsc cycles):\n");
+	printf("%-6s %-18s %14s %18s %18s %7s\n", "level", "stage", "calls", "self", "inclusive", "self%");
+	for (int lv = 0; lv < PROF_LEVELS; ++lv) {
+		char level_name[8];
+
+		if (lv == 0) strcpy(level_name, "driver");
+		else if (lv == PROF_MEM) strcpy(level_name, "mem");
+		else snprintf(level_name, sizeof(level_name), "L%d", lv);
+
+		for (int st = 0; st < PROF_STAGES; ++st) {
+			ProfStage &s = prof_stage[lv][st];
+			if (s.calls == 0)
+				continue;
+			printf("%-6s %-18s %14lu %18lu %18lu %6.2f%%\n", level_name, stage_name[st],
+				s.calls, s.self, s.incl, 100.0 * s.self / total);
+		}
+	}
+
+	for (int i = 0; i < PERF_COUNTERS; ++i) {
+		uint64_t value;
+
+		if (perf_fd[i] < 0) {
+			printf("%s:\tunavailable\n", perf_name[i]);
+			continue;
+		}
+		ioctl(perf_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(perf_fd[i], &value, sizeof(value)) == sizeof(value))
+			printf("%s:\t%lu\n", perf_name[i], value);
+		close(perf_fd[i]);
+		perf_fd[i] = -1;
+	}
+}
+#else
+void Profile_begin() {}
+void Profile_print() {}
+#endif
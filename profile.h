@@ -0,0 +1,70 @@
+#ifndef CACHE_PROFILE_H_
+#define CACHE_PROFILE_H_
+
+#include <stdint.h>
+
+/*
+** Self-profiling of the simulator pipeline (build with CACHE_PROFILE).
+** PROFILE_SCOPE(level, stage) times the rest of the enclosing block with
+** rdtsc; time spent in nested scopes is charged to them, not to the
+** parent, so self cycles of all rows add up to the profiled total.
+** The counters are per thread; Profile_print() shows the calling one.
+** Without CACHE_PROFILE the macros expand to nothing.
+*/
+
+#define PROF_TRACE	0 // waiting for trace records
+#define PROF_HANDLE	1 // HandleRequest outside the stages below;
+			  // inclusive time of a level is the recursion cost seen from above
+#define PROF_BYPASS	2 // BypassDecision + BypassUpdatestat
+#define PROF_PREFETCH	3 // PrefetchDecision + PrefetchAlgorithm
+#define PROF_DECISION	4 // ReplaceDecision
+#define PROF_REPLACE	5 // ReplaceAlgorithm
+#define PROF_STAGES	6
+
+#define PROF_LEVELS	12 // 0: driver, 1..10: caches, 11: memory
+#define PROF_MEM	(PROF_LEVELS - 1)
+
+#ifdef CACHE_PROFILE
+#include <x86intrin.h>
+
+typedef struct ProfStage_ {
+	uint64_t calls;
+	uint64_t self; // cycles outside nested scopes
+	uint64_t incl; // cycles including nested scopes
+} ProfStage;
+
+extern thread_local ProfStage prof_stage[PROF_LEVELS][PROF_STAGES];
+extern thread_local uint64_t prof_child; // cycles of finished children of the open scope
+
+struct ProfScope {
+	uint64_t start, saved_child;
+	ProfStage *stage;
+
+	ProfScope(int level, int stage_id)
+	{
+		stage = &prof_stage[level][stage_id];
+		saved_child = prof_child;
+		prof_child = 0;
+		start = __rdtsc();
+	}
+	~ProfScope()
+	{
+		uint64_t elapsed = __rdtsc() - start;
+		++stage->calls;
+		stage->incl += elapsed;
+		stage->self += elapsed - prof_child;
+		prof_child = saved_child + elapsed;
+	}
+};
+
+#define PROFILE_SCOPE(level, stage) ProfScope prof_scope_(level, stage)
+#else
+#define PROFILE_SCOPE(level, stage) do { } while (0)
+#endif
+
+// Start hardware counters (perf_event) for the whole run
+void Profile_begin();
+// Breakdown table on stdout
+void Profile_print();
+
+#endif //CACHE_PROFILE_H_
@@ -0,0 +1,109 @@
+#include <math.h>
+#include "sample.h"
+
+Sampler::Sampler()
+{
+	memory_ = NULL;
+	level_num_ = 0;
+	unit_ = warm_ = period_ = 0;
+	pos_ = phase_ = 0;
+	measuring_ = 0;
+}
+
+bool Sampler::Configure(uint64_t unit, uint64_t warm, uint64_t k)
+{
+	if (unit == 0 || k == 0 || k * unit < unit + warm)
+		return false;
+	unit_ = unit;
+	warm_ = warm;
+	period_ = k * unit;
+	return true;
+}
+
+void Sampler::Begin(Storage **levels, StorageLatency *latencies, int level_num, Storage *memory)
+{
+	if (level_num > SAMPLE_LEVELS)
+		level_num = SAMPLE_LEVELS;
+	for (int i = 0; i < level_num; ++i) {
+		levels_[i] = levels[i];
+		latency_[i] = latencies[i];
+		mr_n_[i] = 0;
+		mr_sum_[i] = mr_sq_[i] = 0;
+	}
+	memory_ = memory;
+	level_num_ = level_num;
+	amat_n_ = 0;
+	amat_sum_ = amat_sq_ = 0;
+	measured_access_ = measured_cycle_ = 0;
+	pos_ = 0;
+	measuring_ = 1;
+}
+
+void Sampler::UnitBegin()
+{
+	for (int i = 0; i < level_num_; ++i)
+		levels_[i] -> GetStats(start_[i]);
+	memory_ -> GetStats(start_[level_num_]);
+}
+
+void Sampler::UnitEnd()
+{
+	double mr[SAMPLE_LEVELS];
+	StorageStats now;
+
+	for (int i = 0; i < level_num_; ++i) {
+		levels_[i] -> GetStats(now);
+		uint64_t access = now.access_counter - start_[i].access_counter;
+		uint64_t miss = now.miss_num - start_[i].miss_num;
+
+		// a level the unit never reached misses nothing
+		mr[i] = access ? (double) miss / access : 0;
+		if (access) {
+			++mr_n_[i];
+			mr_sum_[i] += mr[i];
+			mr_sq_[i] += mr[i] * mr[i];
+		}
+		if (i == 0)
+			measured_access_ += access;
+		measured_cycle_ += now.access_cycle - start_[i].access_cycle;
+	}
+	memory_ -> GetStats(now);
+	measured_cycle_ += now.access_cycle - start_[level_num_].access_cycle;
+
+	// same model as the full report, main memory at 100 cycles
+	double amat = 100;
+	for (int i = level_num_ - 1; i >= 0; --i)
+		amat = latency_[i].hit_latency + mr[i] * (latency_[i].bus_latency + amat);
+	++amat_n_;
+	amat_sum_ += amat;
+	amat_sq_ += amat * amat;
+}
+
+static double Mean_ci(uint64_t n, double sum, double sq, double &ci)
+{
+	if (n == 0) {
+		ci = 0;
+		return 0;
+	}
+	double mean = sum / n;
+	double var = n > 1 ? (sq - sum * mean) / (n - 1) : 0;
+	ci = 1.96 * sqrt(var > 0 ? var : 0) / sqrt((double) n);
+	return mean;
+}
+
+double Sampler::MissRate(int i, double &ci)
+{
+	return Mean_ci(mr_n_[i], mr_sum_[i], mr_sq_[i], ci);
+}
+
+double Sampler::AMAT(double &ci)
+{
+	return Mean_ci(amat_n_, amat_sum_, amat_sq_, ci);
+}
+
+uint64_t Sampler::Cycles(uint64_t accesses)
+{
+	if (measured_access_ == 0)
+		return 0;
+	return (uint64_t) ((double) measured_cycle_ * accesses / measured_access_);
+}
@@ -0,0 +1,77 @@
+#ifndef CACHE_SAMPLE_H_
+#define CACHE_SAMPLE_H_
+
+#include <stdint.h>
+#include "storage.h"
+
+#define SAMPLE_LEVELS	10
+
+/*
+** SMARTS-style systematic sampling. The access stream is cut into periods
+** of `period` accesses; the last `warm` + `unit` accesses of each period
+** run the detailed model and the final `unit` of those are measured. All
+** other accesses are only fast-forwarded (functional warming).
+*/
+class Sampler {
+private:
+	void UnitBegin();
+	void UnitEnd();
+
+	// levels_[0..level_num_-1] are caches, memory_ is main memory
+	Storage *levels_[SAMPLE_LEVELS];
+	Storage *memory_;
+	StorageLatency latency_[SAMPLE_LEVELS];
+	int level_num_;
+
+	uint64_t unit_, warm_, period_;
+	uint64_t pos_, phase_;
+	int measuring_;
+
+	StorageStats start_[SAMPLE_LEVELS + 1];
+	// Per-unit estimates: count, sum, sum of squares
+	uint64_t mr_n_[SAMPLE_LEVELS];
+	double mr_sum_[SAMPLE_LEVELS], mr_sq_[SAMPLE_LEVELS];
+	uint64_t amat_n_;
+	double amat_sum_, amat_sq_;
+	// Totals over measured units, for extrapolation
+	uint64_t measured_access_, measured_cycle_;
+
+	DISALLOW_COPY_AND_ASSIGN(Sampler);
+
+public:
+	Sampler();
+
+	// Detailed unit and warming lengths, one unit measured every `k` units
+	bool Configure(uint64_t unit, uint64_t warm, uint64_t k);
+	bool Enabled() { return period_ > 0; }
+
+	// Start measuring; latencies[i] belongs to levels[i]
+	void Begin(Storage **levels, StorageLatency *latencies, int level_num, Storage *memory);
+	void End() { measuring_ = 0; }
+
+	// Per access: Detailed() says whether to run the full model, call
+	// Advance() after a detailed access
+	bool Detailed()
+	{
+		if (!measuring_)
+			return false;
+		phase_ = pos_++ % period_;
+		if (phase_ == period_ - unit_)
+			UnitBegin();
+		return phase_ >= period_ - unit_ - warm_;
+	}
+	void Advance()
+	{
+		if (phase_ == period_ - 1)
+			UnitEnd();
+	}
+
+	uint64_t Units() { return amat_n_; }
+	// Mean over units, 95% confidence half-width in ci
+	double MissRate(int i, double &ci);
+	double AMAT(double &ci);
+	// Total cycles scaled from the measured units to `accesses`
+	uint64_t Cycles(uint64_t accesses);
+};
+
+#endif //CACHE_SAMPLE_H_
@@ -0,0 +1,183 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <new>
+#include <thread>
+#include "shm.h"
+
+ShmRing::ShmRing()
+{
+	hdr_ = NULL;
+	rec_ = NULL;
+	map_size_ = 0;
+	name_[0] = '\0';
+	owner_ = 0;
+	mode_ = SHM_BLOCK;
+	cached_tail_ = 0;
+	mask_ = 0;
+}
+
+ShmRing::~ShmRing()
+{
+	if (hdr_ != NULL)
+		munmap(hdr_, map_size_);
+	if (owner_)
+		shm_unlink(name_);
+}
+
+bool ShmRing::Map(int fd, size_t size)
+{
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	close(fd);
+	if (base == MAP_FAILED)
+		return false;
+	hdr_ = (ShmRingHeader *) base;
+	rec_ = (TraceRecord *) ((char *) base + sizeof(ShmRingHeader));
+	map_size_ = size;
+	return true;
+}
+
+ShmRing *ShmRing::Create(const char *name, uint64_t capacity)
+{
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+		printf("Shared ring capacity %lu is not a power of 2\n", capacity);
+		return NULL;
+	}
+
+	size_t size = sizeof(ShmRingHeader) + capacity * sizeof(TraceRecord);
+	int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) {
+		if (errno == EEXIST)
+			printf("%s already exists, left by a run that did not exit cleanly? "
+				"Remove it with shm_unlink(\"%s\") or rm /dev/shm/%s\n",
+				name, name, name[0] == '/' ? name + 1 : name);
+		else
+			perror(name);
+		return NULL;
+	}
+	if (ftruncate(fd, size) != 0) {
+		perror(name);
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	ShmRing *ring = new ShmRing;
+	snprintf(ring->name_, sizeof(ring->name_), "%s", name);
+	ring->owner_ = 1;
+	if (!ring->Map(fd, size)) {
+		delete ring;
+		return NULL;
+	}
+
+	ShmRingHeader *hdr = new (ring->hdr_) ShmRingHeader;
+	hdr->capacity = capacity;
+	hdr->head.store(0);
+	hdr->dropped.store(0);
+	hdr->stalls.store(0);
+	hdr->closed.store(0);
+	hdr->tail.store(0);
+	ring->mask_ = capacity - 1;
+	// publish last, Attach() checks it
+	std::atomic_thread_fence(std::memory_order_release);
+	hdr->magic = SHM_RING_MAGIC;
+	return ring;
+}
+
+ShmRing *ShmRing::Attach(const char *name, int mode)
+{
+	int fd = shm_open(name, O_RDWR, 0600);
+	struct stat st;
+
+	if (fd < 0) {
+		perror(name);
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ShmRingHeader)) {
+		close(fd);
+		return NULL;
+	}
+
+	ShmRing *ring = new ShmRing;
+	snprintf(ring->name_, sizeof(ring->name_), "%s", name);
+	if (!ring->Map(fd, st.st_size) || ring->hdr_->magic != SHM_RING_MAGIC) {
+		printf("%s is not a trace ring\n", name);
+		delete ring;
+		return NULL;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	// the index mask needs a power of 2; bound it by the mapping before multiplying
+	uint64_t capacity = ring->hdr_->capacity;
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0
+	 || capacity > ((size_t) st.st_size - sizeof(ShmRingHeader)) / sizeof(TraceRecord)) {
+		printf("%s has a bad ring capacity %lu\n", name, capacity);
+		delete ring;
+		return NULL;
+	}
+	ring->mask_ = capacity - 1;
+	ring->mode_ = mode;
+	ring->cached_tail_ = ring->hdr_->tail.load(std::memory_order_acquire);
+	return ring;
+}
+
+int ShmRing::Push(const TraceRecord &rec)
+{
+	uint64_t head = hdr_->head.load(std::memory_order_relaxed);
+
+	if (head - cached_tail_ > mask_) {
+		cached_tail_ = hdr_->tail.load(std::memory_order_acquire);
+		if (head - cached_tail_ > mask_) {
+			if (mode_ == SHM_DROP) {
+				hdr_->dropped.fetch_add(1, std::memory_order_relaxed);
+				return 0;
+			}
+			hdr_->stalls.fetch_add(1, std::memory_order_relaxed);
+			do {
+				std::this_thread::yield();
+				cached_tail_ = hdr_->tail.load(std::memory_order_acquire);
+			} while (head - cached_tail_ > mask_);
+		}
+	}
+	rec_[head & mask_] = rec;
+	hdr_->head.store(head + 1, std::memory_order_release);
+	return 1;
+}
+
+void ShmRing::Detach()
+{
+	hdr_->closed.store(1, std::memory_order_release);
+}
+
+size_t ShmRing::Peek(const TraceRecord *&recs)
+{
+	uint64_t tail = hdr_->tail.load(std::memory_order_relaxed);
+	uint64_t head = hdr_->head.load(std::memory_order_acquire);
+	uint64_t run = hdr_->capacity - (tail & mask_);
+
+	recs = rec_ + (tail & mask_);
+	return head - tail < run ? head - tail : run;
+}
+
+void ShmRing::Consume(size_t num)
+{
+	hdr_->tail.store(hdr_->tail.load(std::memory_order_relaxed) + num, std::memory_order_release);
+}
+
+bool ShmRing::Finished()
+{
+	// closed first, so records published before it are seen by the head load
+	if (!hdr_->closed.load(std::memory_order_acquire))
+		return false;
+	return hdr_->head.load(std::memory_order_acquire) == hdr_->tail.load(std::memory_order_relaxed);
+}
+
+void ShmRing::GetCounters(uint64_t &consumed, uint64_t &dropped, uint64_t &stalls)
+{
+	consumed = hdr_->tail.load(std::memory_order_relaxed);
+	dropped = hdr_->dropped.load(std::memory_order_relaxed);
+	stalls = hdr_->stalls.load(std::memory_order_relaxed);
+}
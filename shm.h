@@ -0,0 +1,73 @@
+#ifndef CACHE_SHM_H_
+#define CACHE_SHM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "storage.h"
+#include "trace.h"
+
+#define SHM_RING_MAGIC	0x43534D52494E4733ULL // bumped with the TraceRecord layout
+#define SHM_RING_CAP	(1 << 20) // default records, power of 2
+
+#define SHM_BLOCK	0x0 // producer waits for space
+#define SHM_DROP	0x1 // producer drops the sample
+
+// Lives at the start of the shared mapping, records follow it
+typedef struct ShmRingHeader_ {
+	uint64_t magic;
+	uint64_t capacity;
+
+	alignas(64) std::atomic<uint64_t> head; // records published
+	std::atomic<uint64_t> dropped; // samples lost while full
+	std::atomic<uint64_t> stalls; // pushes that had to wait
+	std::atomic<uint32_t> closed; // producer detached
+
+	alignas(64) std::atomic<uint64_t> tail; // records consumed
+} ShmRingHeader;
+
+/*
+** Single-producer/single-consumer ring of TraceRecord in POSIX shared
+** memory. The simulator creates the ring and drains it in place; a tracer
+** attaches to it and pushes accesses.
+*/
+class ShmRing {
+private:
+	ShmRingHeader *hdr_;
+	TraceRecord *rec_;
+	size_t map_size_;
+	char name_[256];
+	int owner_; // created (and unlinks) the segment
+	int mode_; // SHM_BLOCK | SHM_DROP, producer only
+	uint64_t cached_tail_; // producer's view of tail
+	uint64_t mask_;
+
+	ShmRing();
+	bool Map(int fd, size_t size);
+
+	DISALLOW_COPY_AND_ASSIGN(ShmRing);
+
+public:
+	~ShmRing();
+
+	// Consumer: create the segment, NULL on failure
+	static ShmRing *Create(const char *name, uint64_t capacity);
+	// Producer: attach to an existing segment, NULL on failure
+	static ShmRing *Attach(const char *name, int mode);
+
+	// Producer side
+	// 1 if the record was queued, 0 if it was dropped
+	int Push(const TraceRecord &rec);
+	void Detach();
+
+	// Consumer side
+	// Contiguous run of unread records, 0 when none is ready yet
+	size_t Peek(const TraceRecord *&recs);
+	void Consume(size_t num);
+	// Producer detached and every record consumed
+	bool Finished();
+
+	void GetCounters(uint64_t &consumed, uint64_t &dropped, uint64_t &stalls);
+};
+
+#endif //CACHE_SHM_H_
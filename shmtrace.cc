@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "shm.h"
+#include "trace.h"
+
+/*
+** Test producer for `sim shm:NAME`: replays a trace file (or a synthetic
+** sequential stream) into the simulator's shared-memory ring, the same
+** way an instrumentation tool would push accesses.
+*/
+
+void usage(const char *prog)
+{
+	printf("Usage: %s [-d] [-n accesses] NAME [TRACEFILE]\n", prog);
+	printf("\t-d\tdrop samples when the ring is full instead of waiting\n");
+	printf("\t-n\tsynthetic sequential accesses when no trace is given\n");
+}
+
+int main(int argc, char* argv[])
+{
+	int mode = SHM_BLOCK;
+	uint64_t synthetic = 1000000;
+	uint64_t pushed = 0, lost = 0;
+	int failed = 0;
+	ShmRing *ring = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "dn:")) != -1) {
+		switch (opt) {
+			case 'd': mode = SHM_DROP; break;
+			case 'n': synthetic = strtoull(optarg, NULL, 0); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// the simulator creates the ring, wait for it
+	for (int i = 0; i < 100 && ring == NULL; ++i) {
+		ring = ShmRing::Attach(argv[optind], mode);
+		if (ring == NULL)
+			usleep(100000);
+	}
+	if (ring == NULL)
+		return 1;
+
+	if (optind + 1 < argc) {
+		TraceReader reader;
+		const TraceBatch *batch;
+
+		if (!reader.Open(argv[optind + 1])) {
+			printf("Cannot open trace file %s\n", argv[optind + 1]);
+			return 1;
+		}
+		while ((batch = reader.Next()) != NULL) {
+			for (int j = 0; j < batch->num; ++j) {
+				if (ring -> Push(batch->rec[j])) ++pushed;
+				else ++lost;
+			}
+			reader.Release();
+		}
+		if (reader.Error() != NULL) {
+			printf("Cannot read trace file %s: %s\n", argv[optind + 1], reader.Error());
+			failed = 1;
+		}
+	}
+	else {
+		TraceRecord rec;
+		memset(&rec, 0, sizeof(rec));
+		for (uint64_t i = 0; i < synthetic; ++i) {
+			rec.addr = i << 3;
+			rec.type = (i & 3) ? 'r' : 'w';
+			if (ring -> Push(rec)) ++pushed;
+			else ++lost;
+		}
+	}
+
+	ring -> Detach();
+	printf("pushed:\t%lu\n", pushed);
+	printf("dropped:\t%lu\n", lost);
+	delete ring;
+	return failed;
+}
@@ -16,6 +16,16 @@ typedef struct StorageStats_ {
 	uint64_t replace_num; // Evict old lines
 	uint64_t fetch_num; // Fetch lower layer
 	uint64_t prefetch_num; // Prefetch
+	uint64_t bypass_num; // Sent to lower layer untouched
+	uint64_t skip_num; // Not simulated, set not sampled
+	uint64_t back_inval_num; // Lines dropped for an inclusive lower level
+	uint64_t victim_hit_num; // Misses served by the victim cache
+	uint64_t pred_num; // Evicted lines the reuse predictor had a guess for
+	uint64_t pred_hit_num; // ... where it guessed right
+	uint64_t wbuf_merge_num; // Writes merged into a buffered block
+	uint64_t wbuf_drain_num; // Buffered blocks written to the lower layer
+	uint64_t wbuf_stall_cycle; // Lower layer cycles of drains forced by a full buffer
+	uint64_t direct_num; // Memory: writes that skipped the last cache level
 
 	StorageStats_ ()
 	{
@@ -25,6 +35,16 @@ typedef struct StorageStats_ {
 		replace_num = 0;
 		fetch_num = 0;
 		prefetch_num = 0;
+		bypass_num = 0;
+		skip_num = 0;
+		back_inval_num = 0;
+		victim_hit_num = 0;
+		pred_num = 0;
+		pred_hit_num = 0;
+		wbuf_merge_num = 0;
+		wbuf_drain_num = 0;
+		wbuf_stall_cycle = 0;
+		direct_num = 0;
 	}
 } StorageStats;
 
@@ -52,13 +72,17 @@ protected:
 
 public:
 	Storage() {}
-	~Storage() {}
+	virtual ~Storage() {}
 
 	// Sets & Gets
 	void SetStats(StorageStats ss) { stats_ = ss; }
 	void GetStats(StorageStats &ss) { ss = stats_; }
 	void SetLatency(StorageLatency sl) { latency_ = sl; }
 	void GetLatency(StorageLatency &sl) { sl = latency_; }
+	uint64_t Cycles() { return stats_.access_cycle; }
+
+	// Back to the just-constructed state
+	virtual void Reset() { stats_ = StorageStats(); }
 	
 	uint64_t print_info()
 	{
@@ -71,11 +95,28 @@ public:
 		printf("access_cycle:\t%ld\n", stats_.access_cycle);
 		printf("replace_num:\t%ld\n", stats_.replace_num);
 		printf("fetch_num:\t%ld\n", stats_.fetch_num);
+		printf("prefetch_num:\t%ld\n", stats_.prefetch_num);
+		printf("bypass_num:\t%ld\n", stats_.bypass_num);
+		// only with an inclusive lower level, a victim cache, a predictor or a write buffer
+		if (stats_.back_inval_num != 0)
+			printf("back_inval_num:\t%ld\n", stats_.back_inval_num);
+		if (stats_.victim_hit_num != 0)
+			printf("victim_hit_num:\t%ld\n", stats_.victim_hit_num);
+		if (stats_.pred_num != 0)
+			printf("predictor_accuracy:\t%3.6f%% (%ld/%ld)\n",
+				100.0 * stats_.pred_hit_num / stats_.pred_num, stats_.pred_hit_num, stats_.pred_num);
+		if (stats_.wbuf_drain_num != 0) {
+			printf("wbuf_merge_num:\t%ld\n", stats_.wbuf_merge_num);
+			printf("wbuf_drain_num:\t%ld\n", stats_.wbuf_drain_num);
+			printf("wbuf_stall_cycle:\t%ld\n", stats_.wbuf_stall_cycle);
+		}
 		
 		return stats_.access_cycle;
 	}
 
 	virtual void HandleRequest(uint64_t addr, int read, int replace_method) = 0;
+	// Functional warming: update contents and replacement state only
+	virtual void FastForward(uint64_t addr, int read, int replace_method) = 0;
 };
 
 #endif //CACHE_STORAGE_H_ 
@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "memory.h"
+#include "trace.h"
+#include "pool.h"
+#include "hierarchy.h"
+
+/*
+** Design-space sweep:
+**	the base hierarchy is read from stdin like sim (cache.cfg), then the
+**	cross product of the given sizes, associativities, block sizes, write
+**	modes, replace methods and bypass thresholds is applied to one level
+**	(the last by default). Points run on a work-stealing pool, each on its
+**	own hierarchy, and every result is kept in the cache directory under
+**	a hash of trace and config, so an extended sweep only runs new points.
+*/
+
+#define SWEEP_LEVELS	3
+#define SWEEP_VERSION	2 // bump when simulation results change
+#define BYPASS_OFF	-1.0
+#define BYPASS_DEFAULT	-2.0 // whatever sim uses for the level
+
+typedef struct SweepPoint_ {
+	int size_kb;
+	int associativity;
+	int block_size;
+	int write_through;
+	int replace_method;
+	double bypass_threshold;
+} SweepPoint;
+
+typedef struct SweepResult_ {
+	double miss_rate[SWEEP_LEVELS + 1];
+	uint64_t total_cycles;
+	double AMAT;
+	int cached;
+} SweepResult;
+
+// Trace, decoded once and shared read-only by the workers
+std::vector<TraceRecord> trace;
+uint64_t trace_hash;
+
+// Base hierarchy from stdin
+int level;
+int base_kb[SWEEP_LEVELS + 1], base_assoc[SWEEP_LEVELS + 1];
+int base_block[SWEEP_LEVELS + 1], base_wt[SWEEP_LEVELS + 1];
+int target;
+
+int warm_passes = 100, measure_passes = 10;
+const char *cache_dir = ".sweep";
+
+std::vector<SweepPoint> points;
+std::vector<SweepResult> results;
+std::mutex progress_lock;
+int done_cnt;
+
+// FNV-1a
+uint64_t Hash(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) data;
+	for (size_t i = 0; i < len; ++i) {
+		h ^= p[i];
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+#define HASH_SEED	0xCBF29CE484222325ULL
+
+bool Load_trace(const char *path)
+{
+	TraceReader reader;
+	const TraceBatch *batch;
+
+	if (!reader.Open(path))
+		return false;
+	trace_hash = HASH_SEED;
+	while ((batch = reader.Next()) != NULL) {
+		for (int j = 0; j < batch->num; ++j) {
+			trace.push_back(batch->rec[j]);
+			trace_hash = Hash(trace_hash, &batch->rec[j].addr, sizeof(uint64_t));
+			trace_hash = Hash(trace_hash, &batch->rec[j].type, 1);
+			trace_hash = Hash(trace_hash, &batch->rec[j].size, sizeof(uint32_t));
+			trace_hash = Hash(trace_hash, &batch->rec[j].pc, sizeof(uint64_t));
+			trace_hash = Hash(trace_hash, &batch->rec[j].tid, sizeof(uint16_t));
+		}
+		reader.Release();
+	}
+	if (reader.Error() != NULL) {
+		printf("Cannot read trace file %s: %s\n", path, reader.Error());
+		return false;
+	}
+	reader.Close();
+	return true;
+}
+
+// Every level's config for a point, latencies in latency[1..level]
+void Point_config(const SweepPoint &p, CacheConfig *config, StorageLatency *latency)
+{
+	for (int i = 1; i <= level; ++i) {
+		if (i == target) {
+			Make_config(config[i], i, p.size_kb, p.associativity, p.block_size, p.write_through);
+			latency[i] = Default_latency(p.size_kb);
+			Default_bypass(config[i]);
+			if (p.bypass_threshold == BYPASS_OFF)
+				config[i].bypass_shiftbit = -1;
+			else if (p.bypass_threshold != BYPASS_DEFAULT) {
+				config[i].bypass_shiftbit = BYPASS_SHIFTBIT;
+				config[i].bypass_threshold = p.bypass_threshold;
+			}
+		}
+		else {
+			Make_config(config[i], i, base_kb[i], base_assoc[i], base_block[i], base_wt[i]);
+			latency[i] = Default_latency(base_kb[i]);
+			Default_bypass(config[i]);
+		}
+	}
+}
+
+// Everything the result depends on, in a stable text form
+std::string Point_key(const SweepPoint &p)
+{
+	CacheConfig config[SWEEP_LEVELS + 1];
+	StorageLatency latency[SWEEP_LEVELS + 1];
+	char buf[256];
+	std::string key;
+
+	Point_config(p, config, latency);
+	snprintf(buf, sizeof(buf), "v%d trace=%016lx n=%zu warm=%d measure=%d rm=%s", SWEEP_VERSION,
+		trace_hash, trace.size(), warm_passes, measure_passes, Retrieve_name(p.replace_method));
+	key = buf;
+	for (int i = 1; i <= level; ++i) {
+		snprintf(buf, sizeof(buf), " L%d=%d,%d,%d,%d,%d,%lu,%lu,%d,%d,%.6f", i,
+			config[i].size, config[i].associativity, config[i].block_size,
+			config[i].write_through, config[i].write_allocate,
+			latency[i].bus_latency, latency[i].hit_latency, config[i].pf_buf_num,
+			config[i].bypass_shiftbit, config[i].bypass_shiftbit >= 0 ? config[i].bypass_threshold : 0);
+		key += buf;
+	}
+	return key;
+}
+
+std::string Cache_path(const std::string &key)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "/%016lx", Hash(HASH_SEED, key.data(), key.size()));
+	return cache_dir + std::string(buf);
+}
+
+// Cached result: the key line, then the result line
+bool Load_result(const std::string &key, SweepResult &res)
+{
+	FILE *file = fopen(Cache_path(key).c_str(), "r");
+	char line[1024];
+	bool ok = false;
+
+	if (file == NULL)
+		return false;
+	if (fgets(line, sizeof(line), file) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		if (key == line) // not a hash collision
+			ok = fscanf(file, "%lu %lf %lf %lf %lf", &res.total_cycles, &res.AMAT,
+				&res.miss_rate[1], &res.miss_rate[2], &res.miss_rate[3]) == 5;
+	}
+	fclose(file);
+	res.cached = 1;
+	return ok;
+}
+
+// Write to a temporary name and rename, so readers never see half a file
+void Store_result(const std::string &key, const SweepResult &res)
+{
+	std::string path = Cache_path(key);
+	char tmp[64];
+
+	snprintf(tmp, sizeof(tmp), ".%d.%lx", getpid(), (unsigned long) pthread_self());
+	FILE *file = fopen((path + tmp).c_str(), "w");
+	if (file == NULL)
+		return;
+	fprintf(file, "%s\n%lu %.17g %.17g %.17g %.17g\n", key.c_str(), res.total_cycles, res.AMAT,
+		res.miss_rate[1], res.miss_rate[2], res.miss_rate[3]);
+	if (fclose(file) != 0 || rename((path + tmp).c_str(), path.c_str()) != 0)
+		unlink((path + tmp).c_str());
+}
+
+// Same passes and accounting as sim's Simulate() and Report()
+void Simulate_point(const SweepPoint &p, SweepResult &res)
+{
+	CacheConfig config[SWEEP_LEVELS + 1];
+	StorageLatency latency[SWEEP_LEVELS + 1];
+	Cache *cache[SWEEP_LEVELS + 1];
+	Memory memory;
+	int RM = p.replace_method;
+
+	Point_config(p, config, latency);
+	cache[level] = new Cache(config[level], &memory, &memory, latency[level]);
+	Check_allocated(cache[level], level);
+	for (int i = level - 1; i >= 1; i--) {
+		cache[i] = new Cache(config[i], cache[i+1], &memory, latency[i]);
+		Check_allocated(cache[i], i);
+	}
+
+	for (int pass = 0; pass < warm_passes; ++pass)
+		for (size_t j = 0; j < trace.size(); ++j)
+			cache[1] -> Access(trace[j].addr, trace[j].size, trace[j].type == 'r', RM, trace[j].pc, trace[j].tid);
+
+	StorageStats zerostats;
+	memory.SetStats(zerostats);
+	for (int i = 1; i <= level; ++i) {
+		cache[i] -> SetStats(zerostats);
+		cache[i] -> BypassClear();
+	}
+
+	for (int pass = 0; pass < measure_passes; ++pass)
+		for (size_t j = 0; j < trace.size(); ++j)
+			cache[1] -> Access(trace[j].addr, trace[j].size, trace[j].type == 'r', RM, trace[j].pc, trace[j].tid);
+	cache[1] -> Flush(RM);
+
+	StorageStats stats;
+	memset(&res, 0, sizeof(res));
+	for (int i = 1; i <= level; ++i) {
+		cache[i] -> GetStats(stats);
+		res.miss_rate[i] = (double) stats.miss_num / stats.access_counter;
+		res.total_cycles += stats.access_cycle;
+	}
+	memory.GetStats(stats);
+	res.total_cycles += stats.access_cycle;
+
+	res.AMAT = 100;
+	for (int i = level; i >= 1; --i)
+		res.AMAT = latency[i].hit_latency + res.miss_rate[i] * (latency[i].bus_latency + res.AMAT);
+
+	for (int i = 1; i <= level; ++i)
+		delete cache[i];
+}
+
+void Run_point(int id)
+{
+	const SweepPoint &p = points[id];
+	std::string key = Point_key(p);
+
+	if (!Load_result(key, results[id])) {
+		Simulate_point(p, results[id]);
+		Store_result(key, results[id]);
+	}
+
+	std::lock_guard<std::mutex> guard(progress_lock);
+	++done_cnt;
+	fprintf(stderr, "\r%d/%zu points", done_cnt, points.size());
+}
+
+// Comma-separated integers, false on junk
+bool Parse_ints(const char *arg, std::vector<int> &list)
+{
+	char *end;
+
+	list.clear();
+	while (*arg != '\0') {
+		list.push_back(strtol(arg, &end, 0));
+		if (end == arg || (*end != ',' && *end != '\0'))
+			return false;
+		arg = *end == ',' ? end + 1 : end;
+	}
+	return !list.empty();
+}
+
+bool Parse_methods(const char *arg, std::vector<int> &list)
+{
+	char name[16];
+
+	list.clear();
+	while (*arg != '\0') {
+		size_t len = strcspn(arg, ",");
+		if (len == 0 || len >= sizeof(name))
+			return false;
+		memcpy(name, arg, len);
+		name[len] = '\0';
+		int RM = Lookup_name(name);
+		if (RM == -1) {
+			printf("No such Replace Method: %s\n", name);
+			return false;
+		}
+		list.push_back(RM);
+		arg += arg[len] == ',' ? len + 1 : len;
+	}
+	return !list.empty();
+}
+
+// Thresholds in [0, 1] or "off"
+bool Parse_thresholds(const char *arg, std::vector<double> &list)
+{
+	char *end;
+
+	list.clear();
+	while (*arg != '\0') {
+		if (strncmp(arg, "off", 3) == 0) {
+			list.push_back(BYPASS_OFF);
+			end = (char *) arg + 3;
+		}
+		else {
+			list.push_back(strtod(arg, &end));
+			if (end == arg || list.back() < 0 || list.back() > 1)
+				return false;
+		}
+		if (*end != ',' && *end != '\0')
+			return false;
+		arg = *end == ',' ? end + 1 : end;
+	}
+	return !list.empty();
+}
+
+void usage(const char *prog)
+{
+	printf("Usage: %s [options] TRACEFILE < cache.cfg\n", prog);
+	printf("\t-l LEVEL\tlevel the ranges apply to (default the last)\n");
+	printf("\t-s KB,...\tsizes\n");
+	printf("\t-a N,...\tassociativities\n");
+	printf("\t-b N,...\tblock sizes\n");
+	printf("\t-w 0,1\twrite modes (0 write back, 1 write through)\n");
+	printf("\t-p LRU,...\treplace methods (default LRU..LIFO)\n");
+	printf("\t-t T|off,...\tbypass miss-rate thresholds (default as sim)\n");
+	printf("\t-j N\tworker threads (default all)\n");
+	printf("\t-d DIR\tresult cache (default .sweep)\n");
+	printf("\t-W N\twarm-up passes (default 100)\n");
+	printf("\t-M N\tmeasured passes (default 10)\n");
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<int> sizes, assocs, blocks, writes, methods;
+	std::vector<double> thresholds;
+	int threads = 0;
+	int opt;
+
+	target = -1;
+	while ((opt = getopt(argc, argv, "l:s:a:b:w:p:t:j:d:W:M:")) != -1) {
+		bool ok = true;
+		switch (opt) {
+			case 'l': target = atoi(optarg); break;
+			case 's': ok = Parse_ints(optarg, sizes); break;
+			case 'a': ok = Parse_ints(optarg, assocs); break;
+			case 'b': ok = Parse_ints(optarg, blocks); break;
+			case 'w': ok = Parse_ints(optarg, writes); break;
+			case 'p': ok = Parse_methods(optarg, methods); break;
+			case 't': ok = Parse_thresholds(optarg, thresholds); break;
+			case 'j': threads = atoi(optarg); break;
+			case 'd': cache_dir = optarg; break;
+			case 'W': warm_passes = atoi(optarg); break;
+			case 'M': measure_passes = atoi(optarg); break;
+			default: ok = false; break;
+		}
+		if (!ok) {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc || warm_passes < 0 || measure_passes <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (scanf("%d", &level) != 1 || level < 1 || level > SWEEP_LEVELS) {
+		printf("Bad cache level count\n");
+		return 1;
+	}
+	for (int i = 1; i <= level; ++i) {
+		if (scanf("%d%d%d%d", &base_kb[i], &base_assoc[i], &base_block[i], &base_wt[i]) != 4
+		 || Bad_geometry(base_kb[i], base_assoc[i], base_block[i])) {
+			printf("Bad config for level %d\n", i);
+			return 1;
+		}
+	}
+	if (target == -1)
+		target = level;
+	if (target < 1 || target > level) {
+		printf("No level %d in a %d-level hierarchy\n", target, level);
+		return 1;
+	}
+
+	// unswept parameters keep the base value
+	if (sizes.empty()) sizes.push_back(base_kb[target]);
+	if (assocs.empty()) assocs.push_back(base_assoc[target]);
+	if (blocks.empty()) blocks.push_back(base_block[target]);
+	if (writes.empty()) writes.push_back(base_wt[target]);
+	if (thresholds.empty()) thresholds.push_back(BYPASS_DEFAULT);
+	if (methods.empty())
+		for (int RM = CACHE_RM_LRU; RM <= CACHE_RM_LIFO; ++RM)
+			methods.push_back(RM);
+
+	for (size_t s = 0; s < sizes.size(); ++s)
+	for (size_t a = 0; a < assocs.size(); ++a)
+	for (size_t b = 0; b < blocks.size(); ++b) {
+		if (Bad_geometry(sizes[s], assocs[a], blocks[b])) {
+			fprintf(stderr, "Skipping %dKB / %d-way / %dB blocks\n", sizes[s], assocs[a], blocks[b]);
+			continue;
+		}
+		for (size_t w = 0; w < writes.size(); ++w)
+		for (size_t t = 0; t < thresholds.size(); ++t)
+		for (size_t m = 0; m < methods.size(); ++m) {
+			SweepPoint p = { sizes[s], assocs[a], blocks[b], writes[w] != 0, methods[m], thresholds[t] };
+			points.push_back(p);
+		}
+	}
+
+	if (!Load_trace(argv[optind])) {
+		printf("Cannot open trace file %s\n", argv[optind]);
+		return 1;
+	}
+	if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+		perror(cache_dir);
+		return 1;
+	}
+
+	// longest points first, so the stragglers are small ones
+	std::vector<int> order;
+	for (size_t i = 0; i < points.size(); ++i)
+		order.push_back(i);
+	std::stable_sort(order.begin(), order.end(), [](int x, int y) {
+		return points[x].size_kb > points[y].size_kb;
+	});
+
+	WorkPool pool(threads);
+	results.resize(points.size());
+	pool.Run(order, Run_point);
+	fprintf(stderr, "\n");
+
+	int hits = 0;
+	printf("level,size_kb,assoc,block,write_through,bypass,policy");
+	for (int i = 1; i <= level; ++i)
+		printf(",l%d_miss_rate", i);
+	printf(",total_cycles,amat,cached\n");
+	for (size_t i = 0; i < points.size(); ++i) {
+		const SweepPoint &p = points[i];
+		const SweepResult &r = results[i];
+		printf("%d,%d,%d,%d,%d,", target, p.size_kb, p.associativity, p.block_size, p.write_through);
+		if (p.bypass_threshold == BYPASS_OFF)
+			printf("off,");
+		else if (p.bypass_threshold == BYPASS_DEFAULT)
+			printf("default,");
+		else
+			printf("%.3f,", p.bypass_threshold);
+		printf("%s", Retrieve_name(p.replace_method));
+		for (int l = 1; l <= level; ++l)
+			printf(",%.6f", r.miss_rate[l]);
+		printf(",%lu,%.7f,%d\n", r.total_cycles, r.AMAT, r.cached);
+		hits += r.cached;
+	}
+	fprintf(stderr, "%zu points, %d from %s, %d simulated on %d threads\n",
+		points.size(), hits, cache_dir, (int) points.size() - hits, pool.Threads());
+	return 0;
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tlb.h"
+#include "cache.h"
+
+static const int TLB_PAGE_BITS[] = { 12, 21, 30 };
+static const char *TLB_PAGE_NAME[] = { "4KB", "2MB", "1GB" };
+
+Tlb::Tlb()
+{
+	map_ = TLB_MAP_OFF;
+	level_num_ = 0;
+	entry_[0] = entry_[1] = NULL;
+	sets_[0] = TLB_L1_ENTRIES / TLB_L1_WAYS;
+	ways_[0] = TLB_L1_WAYS;
+	sets_[1] = TLB_L2_ENTRIES / TLB_L2_WAYS;
+	ways_[1] = TLB_L2_WAYS;
+	Reset();
+}
+
+Tlb::~Tlb()
+{
+	free(entry_[0]);
+	free(entry_[1]);
+}
+
+bool Tlb::Configure(int map)
+{
+	if (map < TLB_MAP_OFF || map > TLB_MAP_1G)
+		return false;
+	map_ = map;
+	for (int l = 0; l < 2; ++l) {
+		free(entry_[l]);
+		entry_[l] = (TlbEntry *) calloc((size_t) sets_[l] * ways_[l], sizeof(TlbEntry));
+		if (entry_[l] == NULL)
+			return false;
+	}
+	Reset();
+	return true;
+}
+
+void Tlb::Attach(Storage **levels, int level_num)
+{
+	level_num_ = level_num < TLB_LEVELS ? level_num : TLB_LEVELS;
+	for (int i = 0; i < level_num_; ++i)
+		levels_[i] = levels[i];
+}
+
+void Tlb::Reset()
+{
+	for (int l = 0; l < 2; ++l)
+		if (entry_[l] != NULL)
+			memset(entry_[l], 0, sizeof(TlbEntry) * sets_[l] * ways_[l]);
+	frame_.clear();
+	table_.clear();
+	clock_ = 0;
+	Clear();
+}
+
+void Tlb::Clear()
+{
+	memset(stats_, 0, sizeof(stats_));
+	walk_num_ = 0;
+	walk_access_ = 0;
+	walk_cycle_ = 0;
+}
+
+int Tlb::PageClass()
+{
+	if (map_ == TLB_MAP_2M)
+		return TLB_PAGE_2M;
+	if (map_ == TLB_MAP_1G)
+		return TLB_PAGE_1G;
+	return TLB_PAGE_4K;
+}
+
+// Random mappers hand out frame numbers in first-touch order, scrambled by
+// an odd multiplier, which is a bijection modulo the frame count
+uint64_t Tlb::Map(uint64_t vaddr, int page)
+{
+	int bits = TLB_PAGE_BITS[page];
+	uint64_t offset = vaddr & ((1ULL << bits) - 1);
+
+	if (map_ == TLB_MAP_IDENTITY)
+		return vaddr;
+
+	uint64_t vpn = vaddr >> bits;
+	std::map<uint64_t, uint64_t>::iterator it = frame_.find(vpn);
+	uint64_t frame;
+	if (it != frame_.end())
+		frame = it -> second;
+	else {
+		uint64_t frames = 1ULL << (TLB_PHYS_BIT - bits);
+		frame = (frame_.size() * 0x9E3779B97F4A7C15ULL) & (frames - 1);
+		frame_[vpn] = frame;
+	}
+	return frame << bits | offset;
+}
+
+int Tlb::Lookup(int l, uint64_t vpn, uint64_t key)
+{
+	TlbEntry *set = entry_[l] + (size_t) (vpn % sets_[l]) * ways_[l];
+	int victim = 0;
+
+	++stats_[l].access;
+	++clock_;
+	for (int w = 0; w < ways_[l]; ++w) {
+		if (set[w].key == key) {
+			set[w].stamp = clock_;
+			return 1;
+		}
+		if (set[w].stamp < set[victim].stamp)
+			victim = w;
+	}
+	++stats_[l].miss;
+	set[victim].key = key;
+	set[victim].stamp = clock_;
+	return 0;
+}
+
+uint64_t Tlb::LevelCycles()
+{
+	StorageStats stats;
+	uint64_t cycles = 0;
+
+	for (int i = 0; i < level_num_; ++i) {
+		levels_[i] -> GetStats(stats);
+		cycles += stats.access_cycle;
+	}
+	return cycles;
+}
+
+// One read per radix level: 9 index bits per level from bit 39 down,
+// the walk stops at the level that maps the page
+void Tlb::Walk(uint64_t vaddr, int page, int replace_method, int detailed)
+{
+	int depth = 4 - page;
+	uint64_t start = detailed ? LevelCycles() : 0;
+
+	for (int d = 0; d < depth; ++d) {
+		int shift = 39 - 9 * d;
+		uint64_t key = (uint64_t) d << 56 | vaddr >> (shift + 9); // root: one per stream
+		std::map<uint64_t, uint64_t>::iterator it = table_.find(key);
+		uint64_t node;
+		if (it != table_.end())
+			node = it -> second;
+		else {
+			node = table_.size();
+			table_[key] = node;
+		}
+		uint64_t pte = TLB_PT_BASE + (node << 12) + ((vaddr >> shift) & 511) * 8;
+		pte |= vaddr >> MIX_TAG_BIT << MIX_TAG_BIT; // the walking stream's tables
+		if (detailed)
+			levels_[0] -> HandleRequest(pte, CACHE_READ, replace_method);
+		else
+			levels_[0] -> FastForward(pte, CACHE_READ, replace_method);
+	}
+
+	if (detailed) {
+		++walk_num_;
+		walk_access_ += depth;
+		walk_cycle_ += LevelCycles() - start;
+	}
+}
+
+uint64_t Tlb::Translate(uint64_t vaddr, uint64_t &page_end, int replace_method, int detailed)
+{
+	int page = PageClass();
+	int bits = TLB_PAGE_BITS[page];
+	uint64_t vpn = vaddr >> bits;
+	uint64_t key = (vpn << 2 | page) + 1;
+
+	page_end = (vpn + 1) << bits;
+	if (!detailed) {
+		TlbStats saved[2];
+		memcpy(saved, stats_, sizeof(saved));
+		if (!Lookup(0, vpn, key) && !Lookup(1, vpn, key))
+			Walk(vaddr, page, replace_method, 0);
+		memcpy(stats_, saved, sizeof(saved));
+	}
+	else if (!Lookup(0, vpn, key) && !Lookup(1, vpn, key))
+		Walk(vaddr, page, replace_method, 1);
+	return Map(vaddr, page);
+}
+
+void Tlb::PrintInfo()
+{
+	printf("TLB info (%s pages):\n", TLB_PAGE_NAME[PageClass()]);
+	for (int l = 0; l < 2; ++l) {
+		double miss_rate = stats_[l].access ? 100.0 * stats_[l].miss / stats_[l].access : 0;
+		printf("L%d_tlb_access:\t%ld\n", l + 1, stats_[l].access);
+		printf("L%d_tlb_miss_rate:\t%3.6f%%\n", l + 1, miss_rate);
+	}
+	printf("walk_num:\t%ld\n", walk_num_);
+	printf("walk_access:\t%ld\n", walk_access_);
+	printf("walk_cycle:\t%ld\n", walk_cycle_);
+	printf("tlb_cycle:\t%ld\n", Cycles());
+}
@@ -0,0 +1,105 @@
+#ifndef CACHE_TLB_H_
+#define CACHE_TLB_H_
+
+#include <stdint.h>
+#include <map>
+#include "storage.h"
+
+// Virtual-to-physical mappers
+#define TLB_MAP_OFF	0x0 // no translation
+#define TLB_MAP_IDENTITY	0x1 // 4KB pages, physical = virtual
+#define TLB_MAP_RANDOM	0x2 // 4KB pages, frames scattered on first touch
+#define TLB_MAP_2M	0x3 // 2MB pages, frames scattered on first touch
+#define TLB_MAP_1G	0x4 // 1GB pages, frames scattered on first touch
+
+#define TLB_PAGE_4K	0 // size classes, page bits in TLB_PAGE_BITS
+#define TLB_PAGE_2M	1
+#define TLB_PAGE_1G	2
+
+#define TLB_LEVELS	11 // cache levels and memory that walks may touch
+
+#define TLB_PHYS_BIT	40 // physical address space of the random mappers
+#define TLB_PT_BASE	(1ULL << 52) // page tables live above any data frame
+
+// L1 dTLB and shared L2 TLB, entries / ways / hit cycles
+#define TLB_L1_ENTRIES	64
+#define TLB_L1_WAYS	4
+#define TLB_L2_ENTRIES	1536
+#define TLB_L2_WAYS	12
+#define TLB_L2_LATENCY	7 // the L1 lookup overlaps the cache access
+
+typedef struct TlbEntry_ {
+	uint64_t key; // (vpn << 2 | size class) + 1, 0 for an invalid entry
+	uint64_t stamp; // LRU
+} TlbEntry;
+
+typedef struct TlbStats_ {
+	uint64_t access;
+	uint64_t miss;
+} TlbStats;
+
+/*
+** Two-level TLB in front of the cache hierarchy. A miss in both levels
+** walks a 4-level x86-64 style radix table (3 levels for 2MB pages, 2 for
+** 1GB), one 8-byte read per level issued into L1 like any other access.
+** Page table pages are numbered on first use above TLB_PT_BASE.
+*/
+class Tlb {
+private:
+	// Mapper: page size class and physical address of vaddr
+	int PageClass();
+	uint64_t Map(uint64_t vaddr, int page);
+	// Lookup of key in the set of vpn in level `l`, fills the entry on a
+	// miss; 1 on a hit
+	int Lookup(int l, uint64_t vpn, uint64_t key);
+	void Walk(uint64_t vaddr, int page, int replace_method, int detailed);
+	uint64_t LevelCycles();
+
+	int map_;
+
+	// levels_[0] takes the walk accesses, the rest only add up cycles
+	Storage *levels_[TLB_LEVELS];
+	int level_num_;
+
+	TlbEntry *entry_[2];
+	int sets_[2], ways_[2];
+	TlbStats stats_[2];
+	uint64_t clock_;
+
+	// Walks
+	uint64_t walk_num_, walk_access_, walk_cycle_;
+	std::map<uint64_t, uint64_t> frame_; // virtual page -> frame, random mappers
+	std::map<uint64_t, uint64_t> table_; // (depth, vaddr prefix) -> page table page
+
+	DISALLOW_COPY_AND_ASSIGN(Tlb);
+
+public:
+	Tlb();
+	~Tlb();
+
+	bool Configure(int map);
+	bool Enabled() { return map_ != TLB_MAP_OFF; }
+	// levels[0] is L1, memory last
+	void Attach(Storage **levels, int level_num);
+
+	// Empty TLBs and page tables, drop stats
+	void Reset();
+	void Clear();
+
+	// Physical address of vaddr; page_end is the first virtual address
+	// past its page. detailed 0 fast-forwards the walk and counts nothing
+	uint64_t Translate(uint64_t vaddr, uint64_t &page_end, int replace_method, int detailed);
+
+	// L2 TLB hit cycles, walks are already in the cache levels' cycles
+	uint64_t Cycles() { return stats_[1].access * TLB_L2_LATENCY; }
+	// Same, scaled from the detailed translations to `accesses`
+	uint64_t Cycles(uint64_t accesses)
+	{
+		if (stats_[0].access == 0)
+			return 0;
+		return (uint64_t) ((double) Cycles() * accesses / stats_[0].access);
+	}
+	void PrintInfo();
+};
+
+#endif //CACHE_TLB_H_
@@ -0,0 +1,272 @@
+#include <string.h>
+#include "trace.h"
+#include "def.h"
+#ifdef CACHE_ZSTD
+#include <zstd.h>
+#endif
+
+TraceReader::TraceReader()
+{
+	file_ = NULL;
+	gz_ = NULL;
+	zstd_ = NULL;
+	in_buf_ = NULL;
+	in_pos_ = in_len_ = 0;
+	head_ = tail_ = 0;
+	done_ = stop_ = error_ = 0;
+	error_msg_[0] = '\0';
+	ring_ = new TraceBatch[TRACE_RING];
+}
+
+TraceReader::~TraceReader()
+{
+	Close();
+	delete[] ring_;
+}
+
+bool TraceReader::Open(const char *path)
+{
+	unsigned char magic[4] = {0, 0, 0, 0};
+
+	Close();
+	file_ = fopen(path, "rb");
+	if (file_ == NULL)
+		return false;
+	
+	// zstd frame magic 0xFD2FB528, anything else goes to zlib
+	// (which reads gzip and passes plain text through)
+	if (fread(magic, 1, 4, file_) == 4
+	 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD) {
+#ifdef CACHE_ZSTD
+		rewind(file_);
+		zstd_ = ZSTD_createDCtx();
+		in_buf_ = new char[TRACE_CHUNK];
+		in_pos_ = in_len_ = 0;
+#else
+		printf("%s is zstd-compressed, rebuild with ZSTD=1\n", path);
+		fclose(file_);
+		file_ = NULL;
+		return false;
+#endif
+	}
+	else {
+		fclose(file_);
+		file_ = NULL;
+		gz_ = gzopen(path, "rb");
+		if (gz_ == NULL)
+			return false;
+		gzbuffer(gz_, TRACE_CHUNK);
+	}
+
+	head_ = tail_ = 0;
+	done_ = stop_ = error_ = 0;
+	error_msg_[0] = '\0';
+	producer_ = std::thread(Produce, this);
+	return true;
+}
+
+void TraceReader::Close()
+{
+	if (producer_.joinable()) {
+		stop_.store(1, std::memory_order_release);
+		producer_.join();
+	}
+	if (gz_ != NULL)
+		gzclose(gz_);
+	if (file_ != NULL)
+		fclose(file_);
+#ifdef CACHE_ZSTD
+	if (zstd_ != NULL)
+		ZSTD_freeDCtx((ZSTD_DCtx *) zstd_);
+#endif
+	delete[] in_buf_;
+	gz_ = NULL;
+	file_ = NULL;
+	zstd_ = NULL;
+	in_buf_ = NULL;
+}
+
+const TraceBatch *TraceReader::Next()
+{
+	uint64_t tail = tail_.load(std::memory_order_relaxed);
+
+	while (head_.load(std::memory_order_acquire) == tail) {
+		if (done_.load(std::memory_order_acquire)
+		 && head_.load(std::memory_order_acquire) == tail)
+			return NULL;
+		std::this_thread::yield();
+	}
+	return &ring_[tail & (TRACE_RING - 1)];
+}
+
+void TraceReader::Release()
+{
+	tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Decompressed bytes into buf, 0 at end of input, -1 on error with the
+// message in error_msg_
+int TraceReader::ReadChunk(char *buf, int len)
+{
+	if (gz_ != NULL) {
+		int n = gzread(gz_, buf, len), errnum = Z_OK;
+		const char *msg = n <= 0 ? gzerror(gz_, &errnum) : NULL;
+		if (n < 0 || errnum != Z_OK) { // a truncated file ends with 0 and Z_BUF_ERROR
+			snprintf(error_msg_, sizeof(error_msg_), "gzip: %s", msg);
+			return -1;
+		}
+		return n;
+	}
+#ifdef CACHE_ZSTD
+	ZSTD_outBuffer out = { buf, (size_t) len, 0 };
+
+	while (out.pos == 0) {
+		if (in_pos_ == in_len_) {
+			in_len_ = fread(in_buf_, 1, TRACE_CHUNK, file_);
+			in_pos_ = 0;
+			if (in_len_ == 0)
+				break;
+		}
+		ZSTD_inBuffer in = { in_buf_, in_len_, in_pos_ };
+		size_t ret = ZSTD_decompressStream((ZSTD_DCtx *) zstd_, &out, &in);
+		if (ZSTD_isError(ret)) {
+			snprintf(error_msg_, sizeof(error_msg_), "zstd: %s", ZSTD_getErrorName(ret));
+			return -1;
+		}
+		in_pos_ = in.pos;
+	}
+	return out.pos;
+#else
+	snprintf(error_msg_, sizeof(error_msg_), "no decompressor");
+	return -1;
+#endif
+}
+
+// Number at p after blanks, hex with a 0x prefix or if hex is set;
+// returns the end of it, or p when there is none
+static const char *ParseNum(const char *p, const char *end, uint64_t &val, int hex)
+{
+	while (p < end && (*p == ' ' || *p == '\t'))
+		++p;
+	if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+		p += 2;
+		hex = 1;
+	}
+
+	const char *digits = p;
+	val = 0;
+	for (; p < end; ++p) {
+		int c = *p;
+		if (c >= '0' && c <= '9') c -= '0';
+		else if (hex && c >= 'a' && c <= 'f') c -= 'a' - 10;
+		else if (hex && c >= 'A' && c <= 'F') c -= 'A' - 10;
+		else break;
+		val = hex ? (val << 4) | c : val * 10 + c;
+	}
+	return p == digits ? digits : p;
+}
+
+int TraceReader::ParseLine(const char *p, const char *end, TraceRecord &rec)
+{
+	const char *next;
+	uint64_t val;
+
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		++p;
+	if (p == end)
+		return FALSE;
+	rec.type = *p++;
+
+	next = ParseNum(p, end, rec.addr, 1);
+	if (next == p)
+		return FALSE;
+
+	// optional: size (decimal), PC (hex), thread id (decimal), time (decimal)
+	rec.size = 0;
+	rec.pc = 0;
+	rec.tid = 0;
+	rec.time = 0;
+	p = next;
+	if ((next = ParseNum(p, end, val, 0)) != p) {
+		if (val > TRACE_SIZE_MAX) {
+			snprintf(error_msg_, sizeof(error_msg_), "access size %lu over %d bytes", val, TRACE_SIZE_MAX);
+			return -1;
+		}
+		rec.size = (uint32_t) val;
+		p = next;
+		if ((next = ParseNum(p, end, val, 1)) != p) {
+			rec.pc = val;
+			p = next;
+			if ((next = ParseNum(p, end, val, 0)) != p) {
+				rec.tid = (uint16_t) val;
+				p = next;
+				if ((next = ParseNum(p, end, val, 0)) != p)
+					rec.time = val;
+			}
+		}
+	}
+	return TRUE;
+}
+
+void TraceReader::Produce(TraceReader *reader)
+{
+	char *buf = new char[TRACE_CHUNK + TRACE_LINE_MAX];
+	int keep = 0;
+	uint64_t head = 0;
+	TraceBatch *batch = NULL;
+
+	while (true) {
+		int n = reader->ReadChunk(buf + keep, TRACE_CHUNK);
+		if (n < 0) { // publish what was read, Error() tells the rest
+			reader->error_.store(1, std::memory_order_relaxed);
+			n = 0;
+		}
+
+		const char *p = buf, *end = buf + keep + n;
+		while (p < end) {
+			const char *nl = (const char *) memchr(p, '\n', end - p);
+			if (nl == NULL) {
+				if (n > 0) // finish the line with the next chunk
+					break;
+				nl = end;
+			}
+
+			// wait for a free slot
+			if (batch == NULL) {
+				while (head - reader->tail_.load(std::memory_order_acquire) >= TRACE_RING) {
+					if (reader->stop_.load(std::memory_order_acquire))
+						goto out;
+					std::this_thread::yield();
+				}
+				batch = &reader->ring_[head & (TRACE_RING - 1)];
+				batch->num = 0;
+			}
+
+			int parsed = reader->ParseLine(p, nl, batch->rec[batch->num]);
+			if (parsed < 0) { // publish what was parsed, Error() tells the rest
+				reader->error_.store(1, std::memory_order_relaxed);
+				break;
+			}
+			if (parsed)
+				++batch->num;
+			if (batch->num == TRACE_BATCH) {
+				reader->head_.store(++head, std::memory_order_release);
+				batch = NULL;
+			}
+			p = nl + 1;
+		}
+
+		keep = p < end ? end - p : 0;
+		if (keep > TRACE_LINE_MAX) // not a trace line, drop it
+			keep = 0;
+		memmove(buf, p, keep);
+		if (n == 0 || reader->error_.load(std::memory_order_relaxed))
+			break;
+	}
+	if (batch != NULL && batch->num > 0)
+		reader->head_.store(++head, std::memory_order_release);
+
+out:
+	reader->done_.store(1, std::memory_order_release);
+	delete[] buf;
+}
@@ -0,0 +1,79 @@
+#ifndef CACHE_TRACE_H_
+#define CACHE_TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <zlib.h>
+#include <atomic>
+#include <thread>
+#include "storage.h"
+
+#define TRACE_BATCH	4096 // records per batch
+#define TRACE_RING	8 // batches in flight, power of 2
+#define TRACE_CHUNK	(1 << 20) // bytes decompressed per read
+#define TRACE_LINE_MAX	256
+#define TRACE_SIZE_MAX	4096 // largest access size, a page; larger ones are corrupt
+
+// One trace access, line format: r|w ADDR [SIZE [PC [TID [TIME]]]]
+typedef struct TraceRecord_ {
+	uint64_t addr;
+	uint64_t pc; // 0 if the trace has none
+	uint32_t size; // bytes, 0 if the trace has none (one block)
+	uint16_t tid; // thread/core
+	char type; // 'r' | 'w'
+	uint64_t time; // timestamp for time-ordered mixing, 0 if the trace has none
+} TraceRecord;
+
+typedef struct TraceBatch_ {
+	int num;
+	TraceRecord rec[TRACE_BATCH];
+} TraceBatch;
+
+/*
+** Streaming trace reader:
+**	a producer thread decompresses (plain, gzip, or zstd with CACHE_ZSTD)
+**	and parses the trace into a single-producer/single-consumer ring of
+**	batches, so the caller can simulate while the rest is still decoded.
+*/
+class TraceReader {
+private:
+	// Producer side
+	static void Produce(TraceReader *reader);
+	int ReadChunk(char *buf, int len);
+	// TRUE for a record, FALSE to skip the line, -1 for a corrupt record
+	int ParseLine(const char *line, const char *end, TraceRecord &rec);
+
+	FILE *file_;
+	gzFile gz_;
+	void *zstd_; // ZSTD_DCtx when built with CACHE_ZSTD
+	char *in_buf_;
+	size_t in_pos_, in_len_;
+
+	std::thread producer_;
+	std::atomic<uint64_t> head_; // batches published
+	std::atomic<uint64_t> tail_; // batches released
+	std::atomic<int> done_; // producer finished
+	std::atomic<int> stop_; // consumer gave up early
+	std::atomic<int> error_; // producer stopped on a read or parse error
+	char error_msg_[TRACE_LINE_MAX];
+	TraceBatch *ring_;
+
+	DISALLOW_COPY_AND_ASSIGN(TraceReader);
+
+public:
+	TraceReader();
+	~TraceReader();
+
+	// Open the trace and start the producer, false if it cannot be read
+	bool Open(const char *path);
+	// Next batch in trace order, NULL at end of trace or on an error
+	const TraceBatch *Next();
+	// Once Next() returned NULL: the decompressor's or parser's message if
+	// the trace could not be read to its end, NULL if it ended cleanly
+	const char *Error() { return error_.load(std::memory_order_acquire) ? error_msg_ : NULL; }
+	// Give the batch returned by Next() back to the producer
+	void Release();
+	void Close();
+};
+
+#endif //CACHE_TRACE_H_